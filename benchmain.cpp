@@ -0,0 +1,104 @@
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include "calcClient.h"
+
+/*
+   Latency/throughput benchmark for the calc server, built on libcalcclient.
+
+   ./bench <IP:port> | unix:<path> [sessions] [concurrency] [bulk]
+
+   Runs <sessions> complete assignment sessions (two round trips each), keeping
+   <concurrency> of them in flight, and reports per-session latency percentiles
+   and sessions per second. Run it once against the UDP address and once against
+   the Unix socket of the same server to compare the transports. With "bulk"
+   every session is a protocol 1.1 bulk assignment, which turns this into a
+   compute-plus-network benchmark; the server only serves those when started
+   with --bulk-count. Start the server with its output redirected, logging
+   dominates otherwise.
+*/
+
+using std::chrono::steady_clock;
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 5) {
+        std::cerr << "Usage: " << argv[0] << " <IP:port> | unix:<path> [sessions] [concurrency] [bulk]" << std::endl;
+        return 1;
+    }
+
+    std::string target(argv[1]);
+    int sessions = argc > 2 ? std::atoi(argv[2]) : 10000;
+    int concurrency = argc > 3 ? std::atoi(argv[3]) : 1;
+    if (sessions <= 0 || concurrency <= 0) {
+        std::cerr << "sessions and concurrency must be positive" << std::endl;
+        return 1;
+    }
+
+    CalcClient client(concurrency);
+    client.retryTimeout = std::chrono::milliseconds(500);
+    client.requestBulk = argc > 4 && std::string(argv[4]) == "bulk";
+
+    bool opened;
+    if (target.compare(0, 5, "unix:") == 0) {
+        opened = client.openUnix(target.substr(5));
+    } else {
+        size_t colonPos = target.rfind(':');
+        opened = colonPos != std::string::npos &&
+                 client.open(target.substr(0, colonPos), std::atoi(target.c_str() + colonPos + 1));
+    }
+    if (!opened) {
+        std::cerr << "Cannot open " << target << ": " << client.error() << std::endl;
+        return 1;
+    }
+
+    std::vector<double> latenciesUs;
+    latenciesUs.reserve(sessions);
+    int submitted = 0, ok = 0, failed = 0;
+
+    // Each completion starts the next session, so concurrency stays constant.
+    std::function<void()> startOne = [&]() {
+        auto start = steady_clock::now();
+        submitted++;
+        client.submit([&, start](const CalcSession& session) {
+            auto elapsed = steady_clock::now() - start;
+            latenciesUs.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+            if (session.status == CalcStatus::Ok) {
+                ok++;
+            } else {
+                failed++;
+            }
+            if (submitted < sessions) {
+                startOne();
+            }
+        });
+    };
+
+    auto begin = steady_clock::now();
+    for (int i = 0; i < concurrency && submitted < sessions; i++) {
+        startOne();
+    }
+    while (client.inFlight() > 0) {
+        if (client.poll(-1) < 0) {
+            std::cerr << client.error() << std::endl;
+            return 1;
+        }
+    }
+    double seconds = std::chrono::duration<double>(steady_clock::now() - begin).count();
+
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    auto percentile = [&](double p) {
+        return latenciesUs[std::min(latenciesUs.size() - 1, (size_t)(p * latenciesUs.size()))];
+    };
+
+    std::cout << "target=" << target << " sessions=" << sessions << " concurrency=" << concurrency
+              << (client.requestBulk ? " bulk" : "") << std::endl;
+    std::cout << "ok=" << ok << " failed=" << failed << std::endl;
+    std::cout << "latency us: p50=" << percentile(0.50) << " p90=" << percentile(0.90)
+              << " p99=" << percentile(0.99) << " max=" << latenciesUs.back() << std::endl;
+    std::cout << "throughput: " << sessions / seconds << " sessions/s" << std::endl;
+    return failed == 0 ? 0 : 2;
+}
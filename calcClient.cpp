@@ -0,0 +1,810 @@
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <memory>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "calcClient.h"
+#include "calcLib.h"
+
+using std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+// Bulk assignments are recognised by type, since a small one can be exactly
+// as long as a calcProtocol.
+static bool isBulkAssignment(const char* buffer, ssize_t len) {
+    calcBulkProtocol header;
+    if (len < (ssize_t)sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, buffer, sizeof(header));
+    return ntohs(header.type) == 11;
+}
+
+static bool isAssignment(const char* buffer, ssize_t len) {
+    return isBulkAssignment(buffer, len) || len == sizeof(calcProtocol);
+}
+
+CalcClient::CalcClient(size_t poolSize) : pool(poolSize) {
+    freeSlots.reserve(poolSize);
+    for (size_t i = poolSize; i > 0; --i) {
+        freeSlots.push_back(i - 1);
+    }
+
+    memset(&hello, 0, sizeof(hello));
+    hello.type = htons(22);             // Client-to-server binary protocol
+    hello.message = htonl(0);           // First message
+    hello.protocol = htons(17);         // UDP protocol
+    hello.major_version = htons(1);     // Protocol version 1.0
+    hello.minor_version = htons(0);
+}
+
+CalcClient::~CalcClient() {
+    close();
+}
+
+// The resolution cache is a text file with one line per address, in the order
+// open() should try them: <host> <port> <expires, unix time> <numeric address>
+static bool readCache(const std::string& path, const std::string& host, int port,
+                      std::vector<sockaddr_storage>& addrs, std::vector<socklen_t>& lens) {
+    std::ifstream in(path);
+    std::string line;
+    long now = time(nullptr);
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string entryHost, address;
+        int entryPort;
+        long expires;
+        if (!(fields >> entryHost >> entryPort >> expires >> address) ||
+            entryHost != host || entryPort != port || expires <= now) {
+            continue;
+        }
+
+        struct addrinfo hints{}, *res;
+        hints.ai_flags = AI_NUMERICHOST;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo(address.c_str(), std::to_string(port).c_str(), &hints, &res) != 0) {
+            continue;
+        }
+        sockaddr_storage addr;
+        memcpy(&addr, res->ai_addr, res->ai_addrlen);
+        addrs.push_back(addr);
+        lens.push_back(res->ai_addrlen);
+        freeaddrinfo(res);
+    }
+    return !addrs.empty();
+}
+
+static void writeCache(const std::string& path, const std::string& host, int port, long ttl,
+                       const std::vector<std::string>& addresses) {
+    // Keep other hosts' live entries, replace ours, and swap the file in whole.
+    std::ifstream in(path);
+    std::ostringstream out;
+    std::string line;
+    long now = time(nullptr);
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string entryHost;
+        int entryPort;
+        long expires;
+        if ((fields >> entryHost >> entryPort >> expires) && expires > now &&
+            !(entryHost == host && entryPort == port)) {
+            out << line << "\n";
+        }
+    }
+    for (const std::string& address : addresses) {
+        out << host << " " << port << " " << now + ttl << " " << address << "\n";
+    }
+
+    std::string tmp = path + "." + std::to_string(getpid());
+    std::ofstream file(tmp);
+    file << out.str();
+    file.close();
+    if (!file || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+    }
+}
+
+bool CalcClient::resolve(const std::string& host, int port, std::vector<Candidate>& candidates) {
+    struct addrinfo hints{}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    int status = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res);
+    if (status != 0) {
+        lastError = std::string("Error resolving address: ") + gai_strerror(status);
+        return false;
+    }
+
+    // RFC 8305 section 4: alternate families, starting with the first one
+    // the resolver preferred.
+    std::vector<Candidate> preferred, other;
+    for (struct addrinfo* p = res; p != nullptr; p = p->ai_next) {
+        Candidate c;
+        memcpy(&c.addr, p->ai_addr, p->ai_addrlen);
+        c.addrLen = p->ai_addrlen;
+        c.resolved = true;
+        (p->ai_family == res->ai_family ? preferred : other).push_back(c);
+    }
+    freeaddrinfo(res);
+
+    for (size_t i = 0; i < std::max(preferred.size(), other.size()); i++) {
+        if (i < preferred.size()) {
+            candidates.push_back(preferred[i]);
+        }
+        if (i < other.size()) {
+            candidates.push_back(other[i]);
+        }
+    }
+    return true;
+}
+
+void CalcClient::watch(int fd) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static bool sameAddress(const sockaddr_storage& a, socklen_t aLen, const sockaddr_storage& b, socklen_t bLen) {
+    return aLen == bLen && memcmp(&a, &b, aLen) == 0;
+}
+
+// One non-blocking step of the race: collect replies, retransmit, start the
+// next address when its turn comes, and resolve afresh when cached addresses
+// stay silent. Returns the number of sessions this completed.
+int CalcClient::advanceRace() {
+    Race& r = raceState;
+    char buffer[CALC_BULK_MAX_DATAGRAM];
+
+    for (size_t i = 0; i < r.started; i++) {
+        Candidate& c = r.candidates[i];
+        while (!c.failed) {
+            ssize_t len = recv(c.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (len < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    r.lastErrno = errno;  // Port unreachable on this address
+                    c.failed = true;
+                }
+                if (errno != EINTR) {
+                    break;
+                }
+                continue;
+            }
+            if (isAssignment(buffer, len)) {
+                return finishRace(i, buffer, len);
+            }
+        }
+    }
+
+    auto now = steady_clock::now();
+    if (now >= r.deadline) {
+        r.lastErrno = ETIMEDOUT;
+        return failRace();
+    }
+
+    for (size_t i = 0; i < r.started; i++) {
+        Candidate& c = r.candidates[i];
+        if (c.failed || c.deadline > now) {
+            continue;
+        }
+        if (c.attempts >= maxRetries) {
+            r.lastErrno = ETIMEDOUT;
+            c.failed = true;
+        } else {
+            send(c.fd, &hello, sizeof(hello), 0);
+            c.attempts++;
+            c.deadline = now + retryTimeout;
+        }
+    }
+
+    bool anyLive = false;
+    for (size_t i = 0; i < r.started; i++) {
+        anyLive = anyLive || !r.candidates[i].failed;
+    }
+
+    // The cached addresses may be stale: once the first has had raceDelay to
+    // answer, or they have all failed, resolve afresh and let the new ones in.
+    if (r.resolvePending && (now >= r.resolveAt || (!anyLive && r.started == r.candidates.size()))) {
+        r.resolvePending = false;
+        std::vector<Candidate> fresh;
+        if (resolve(r.host, r.port, fresh)) {
+            for (const Candidate& f : fresh) {
+                bool known = false;
+                for (Candidate& c : r.candidates) {
+                    if (sameAddress(c.addr, c.addrLen, f.addr, f.addrLen)) {
+                        c.resolved = known = true;
+                    }
+                }
+                if (!known) {
+                    r.candidates.push_back(f);
+                }
+            }
+        }
+    }
+
+    // Start the next address when its turn comes, or at once if every
+    // address tried so far has already failed.
+    while (r.started < r.candidates.size() && (now >= r.nextStart || !anyLive)) {
+        Candidate& c = r.candidates[r.started++];
+        c.fd = socket(c.addr.ss_family, SOCK_DGRAM, 0);
+        if (c.fd < 0 || connect(c.fd, (struct sockaddr*)&c.addr, c.addrLen) < 0 ||
+            send(c.fd, &hello, sizeof(hello), 0) < 0) {
+            r.lastErrno = errno;
+            c.failed = true;
+        } else {
+            watch(c.fd);
+            c.attempts = 1;
+            c.deadline = now + retryTimeout;
+            anyLive = true;
+        }
+        r.nextStart = now + raceDelay;
+    }
+
+    if (!anyLive && !r.resolvePending) {
+        return failRace();
+    }
+    return 0;
+}
+
+steady_clock::time_point CalcClient::raceWakeAt() const {
+    const Race& r = raceState;
+    auto wakeAt = r.deadline;
+    if (r.started < r.candidates.size()) {
+        wakeAt = std::min(wakeAt, r.nextStart);
+    }
+    if (r.resolvePending) {
+        wakeAt = std::min(wakeAt, r.resolveAt);
+    }
+    for (size_t i = 0; i < r.started; i++) {
+        if (!r.candidates[i].failed) {
+            wakeAt = std::min(wakeAt, r.candidates[i].deadline);
+        }
+    }
+    return wakeAt;
+}
+
+// Keep the winner's socket, remember its addresses, and hand its assignment
+// to the session that has waited longest; the rest send their own hellos now.
+int CalcClient::finishRace(size_t winner, const char* buffer, ssize_t len) {
+    Race& r = raceState;
+    racing = false;
+    for (size_t i = 0; i < r.started; i++) {
+        if (i != winner && r.candidates[i].fd >= 0) {
+            ::close(r.candidates[i].fd);
+        }
+    }
+    sockfd = r.candidates[winner].fd;
+
+    // The winner goes first so the next run tries it first. Once DNS has been
+    // asked, only the addresses it returned are kept, so stale ones expire.
+    bool dnsAsked = !r.cached || !r.resolvePending;
+    if (!cachePath.empty() && (winner != 0 || dnsAsked)) {
+        std::vector<std::string> addresses;
+        for (size_t i = 0; i < r.candidates.size(); i++) {
+            size_t index = i == 0 ? winner : (i <= winner ? i - 1 : i);
+            const Candidate& c = r.candidates[index];
+            if (index != winner && dnsAsked && !c.resolved) {
+                continue;
+            }
+            char numeric[NI_MAXHOST];
+            if (getnameinfo((struct sockaddr*)&c.addr, c.addrLen, numeric, sizeof(numeric),
+                            nullptr, 0, NI_NUMERICHOST) == 0) {
+                addresses.push_back(numeric);
+            }
+        }
+        writeCache(cachePath, r.host, r.port, cacheTtl.count(), addresses);
+    }
+    raceState = Race();
+
+    firstAssignment.assign(buffer, buffer + len);
+    firstAssignmentAt = steady_clock::now();
+
+    int completed = 0;
+    long first = findOldest(SlotState::AwaitAssignment);
+    if (first >= 0) {
+        std::vector<char> assignment;
+        assignment.swap(firstAssignment);
+        completed += acceptAssignment(first, assignment.data(), assignment.size());
+    }
+    for (size_t i = 0; i < pool.size(); ++i) {
+        if (pool[i].state == SlotState::AwaitAssignment && !sendSlot(pool[i])) {
+            complete(i, CalcStatus::Error);
+            completed++;
+        }
+    }
+    return completed;
+}
+
+// No address answered: fail every session that was waiting for the race.
+int CalcClient::failRace() {
+    Race& r = raceState;
+    racing = false;
+    for (size_t i = 0; i < r.started; i++) {
+        if (r.candidates[i].fd >= 0) {
+            ::close(r.candidates[i].fd);
+        }
+    }
+    bool timedOut = r.lastErrno == ETIMEDOUT;
+    if (timedOut) {
+        lastError = "No response from server after " + std::to_string(maxRetries) + " attempts";
+    } else {
+        lastError = std::string("No usable server address: ") + strerror(r.lastErrno);
+    }
+    raceState = Race();
+
+    int completed = 0;
+    for (size_t i = 0; i < pool.size(); ++i) {
+        if (pool[i].state != SlotState::Free) {
+            complete(i, timedOut ? CalcStatus::Timeout : CalcStatus::Error);
+            completed++;
+        }
+    }
+    return completed;
+}
+
+bool CalcClient::open(const std::string& host, int port) {
+    close();
+
+    Race& r = raceState;
+    r.host = host;
+    r.port = port;
+    if (!cachePath.empty()) {
+        std::vector<sockaddr_storage> addrs;
+        std::vector<socklen_t> lens;
+        if (readCache(cachePath, host, port, addrs, lens)) {
+            for (size_t i = 0; i < addrs.size(); i++) {
+                Candidate c;
+                c.addr = addrs[i];
+                c.addrLen = lens[i];
+                r.candidates.push_back(c);
+            }
+            r.cached = r.resolvePending = true;
+        }
+    }
+    if (!r.resolvePending && !resolve(host, port, r.candidates)) {
+        raceState = Race();
+        return false;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        lastError = std::string("epoll_create1 failed: ") + strerror(errno);
+        raceState = Race();
+        return false;
+    }
+
+    // The whole race shares one budget, however many addresses join it.
+    auto now = steady_clock::now();
+    hello.minor_version = htons(requestBulk ? 1 : 0);
+    r.nextStart = now;
+    r.resolveAt = now + raceDelay;
+    r.deadline = now + maxRetries * retryTimeout;
+    racing = true;
+    advanceRace();
+    if (!racing && sockfd < 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool CalcClient::openUnix(const std::string& path) {
+    close();
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        lastError = "Unix socket path too long";
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        lastError = std::string("Socket creation failed: ") + strerror(errno);
+        return false;
+    }
+
+    // Binding just the family autobinds a unique abstract address, which the
+    // server needs to send its replies to.
+    sa_family_t family = AF_UNIX;
+    if (bind(fd, (struct sockaddr*)&family, sizeof(family)) < 0 ||
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        lastError = std::string("Failed to connect to unix:") + path + ": " + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        lastError = std::string("epoll_create1 failed: ") + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    sockfd = fd;
+    watch(sockfd);
+    return true;
+}
+
+void CalcClient::close() {
+    for (size_t i = 0; i < pool.size(); ++i) {
+        if (pool[i].state != SlotState::Free) {
+            complete(i, CalcStatus::Error);
+        }
+    }
+    if (racing) {
+        for (size_t i = 0; i < raceState.started; i++) {
+            if (raceState.candidates[i].fd >= 0) {
+                ::close(raceState.candidates[i].fd);
+            }
+        }
+        racing = false;
+    }
+    raceState = Race();
+    if (sockfd >= 0) {
+        ::close(sockfd);
+        sockfd = -1;
+    }
+    if (epollFd >= 0) {
+        ::close(epollFd);
+        epollFd = -1;
+    }
+    firstAssignment.clear();
+}
+
+bool CalcClient::submit(Callback done) {
+    bool usable = sockfd >= 0 || racing;
+    if (!usable || freeSlots.empty()) {
+        lastError = !usable ? "Client is not open" : "Session pool exhausted";
+        return false;
+    }
+
+    size_t index = freeSlots.back();
+    freeSlots.pop_back();
+
+    Slot& slot = pool[index];
+    slot.session = CalcSession{};
+    slot.state = SlotState::AwaitAssignment;
+    slot.attempts = 0;
+    slot.seq = nextSeq++;
+    slot.done = std::move(done);
+
+    // While the race runs, the session waits for its winner (finishRace()).
+    if (racing) {
+        slot.deadline = raceState.deadline;
+        return true;
+    }
+
+    // The assignment won by the race skips the hello round trip, unless the
+    // server (which forgets sessions after 10 s) may have dropped it.
+    if (!firstAssignment.empty()) {
+        std::vector<char> assignment;
+        assignment.swap(firstAssignment);
+        if (steady_clock::now() - firstAssignmentAt < std::chrono::seconds(5)) {
+            acceptAssignment(index, assignment.data(), assignment.size());
+            return true;
+        }
+    }
+
+    if (!sendSlot(slot)) {
+        complete(index, CalcStatus::Error);
+    }
+    return true;
+}
+
+std::future<CalcSession> CalcClient::submit() {
+    auto promise = std::make_shared<std::promise<CalcSession>>();
+    std::future<CalcSession> future = promise->get_future();
+
+    if (!submit([promise](const CalcSession& session) { promise->set_value(session); })) {
+        CalcSession failed{};
+        failed.status = CalcStatus::Error;
+        promise->set_value(failed);
+    }
+    return future;
+}
+
+// (Re)send whatever the slot is waiting on a reply for and arm its deadline.
+bool CalcClient::sendSlot(Slot& slot) {
+    ssize_t sent;
+    if (slot.state == SlotState::AwaitAssignment) {
+        hello.minor_version = htons(requestBulk ? 1 : 0);
+        sent = send(sockfd, &hello, sizeof(hello), 0);
+    } else if (!slot.session.bulkResult.empty()) {
+        sent = send(sockfd, slot.session.bulkResult.data(), slot.session.bulkResult.size(), 0);
+    } else {
+        sent = send(sockfd, &slot.session.result, sizeof(slot.session.result), 0);
+    }
+    slot.attempts++;
+    slot.deadline = steady_clock::now() + retryTimeout;
+
+    // An ICMP error from an earlier datagram can surface here; the retry
+    // timer covers it just like a lost packet.
+    if (sent < 0 && errno != ECONNREFUSED) {
+        lastError = std::string("Failed to send: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void CalcClient::complete(size_t index, CalcStatus status) {
+    Slot& slot = pool[index];
+    Callback done = std::move(slot.done);
+    CalcSession session = std::move(slot.session);
+    session.status = status;
+
+    slot.state = SlotState::Free;
+    slot.done = nullptr;
+    freeSlots.push_back(index);
+
+    // The slot is already free, so the callback may submit a new session.
+    if (done) {
+        done(session);
+    }
+}
+
+long CalcClient::findOldest(SlotState state) const {
+    long oldest = -1;
+    for (size_t i = 0; i < pool.size(); ++i) {
+        if (pool[i].state == state && (oldest < 0 || pool[i].seq < pool[oldest].seq)) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+// Compute and send the result for an assignment that arrived for a slot.
+// Returns 1 if that completed the session (with an error), otherwise 0.
+int CalcClient::acceptAssignment(size_t index, const char* buffer, ssize_t len) {
+    Slot& slot = pool[index];
+    bool valid;
+    if (isBulkAssignment(buffer, len)) {
+        slot.session.bulkAssignment.assign(buffer, buffer + len);
+        valid = calcComputeBulk(buffer, len, slot.session.bulkResult);
+    } else {
+        memcpy(&slot.session.assignment, buffer, sizeof(calcProtocol));
+        slot.session.result = slot.session.assignment;
+        valid = calcCompute(slot.session.result);
+    }
+    if (!valid) {
+        lastError = "Invalid assignment from server";
+        complete(index, CalcStatus::Error);
+        return 1;
+    }
+
+    slot.state = SlotState::AwaitVerdict;
+    slot.attempts = 0;
+    slot.seq = nextSeq++;
+    if (!sendSlot(slot)) {
+        complete(index, CalcStatus::Error);
+        return 1;
+    }
+    return 0;
+}
+
+int CalcClient::handleDatagram(const char* buffer, ssize_t len) {
+    if (isAssignment(buffer, len)) {
+        // Assignments arrive in no particular order; hand this one to the
+        // session that has waited longest for one.
+        long index = findOldest(SlotState::AwaitAssignment);
+        if (index < 0) {
+            return 0;  // Late reply to a retransmitted hello
+        }
+        return acceptAssignment(index, buffer, len);
+    }
+
+    if (len == sizeof(calcMessage)) {
+        long index = findOldest(SlotState::AwaitVerdict);
+        if (index < 0) {
+            return 0;
+        }
+        calcMessage verdict;
+        memcpy(&verdict, buffer, sizeof(verdict));
+        complete(index, ntohl(verdict.message) == 1 ? CalcStatus::Ok : CalcStatus::NotOk);
+        return 1;
+    }
+
+    return 0;
+}
+
+int CalcClient::handleTimeouts() {
+    if (racing) {
+        return 0;  // Waiting sessions have not sent anything yet
+    }
+    int completed = 0;
+    auto now = steady_clock::now();
+    for (size_t i = 0; i < pool.size(); ++i) {
+        Slot& slot = pool[i];
+        if (slot.state == SlotState::Free || slot.deadline > now) {
+            continue;
+        }
+        if (slot.attempts >= maxRetries) {
+            lastError = "No response from server after " + std::to_string(maxRetries) + " attempts";
+            complete(i, CalcStatus::Timeout);
+            completed++;
+        } else if (!sendSlot(slot)) {
+            complete(i, CalcStatus::Error);
+            completed++;
+        }
+    }
+    return completed;
+}
+
+int CalcClient::poll(int timeoutMs) {
+    if (sockfd < 0 && !racing) {
+        if (epollFd < 0) {
+            lastError = "Client is not open";
+        }
+        return -1;  // After a lost race, error() still says why
+    }
+
+    // Never sleep past the next retransmission or race step.
+    auto now = steady_clock::now();
+    auto wakeAt = racing ? raceWakeAt() : steady_clock::time_point::max();
+    for (const Slot& slot : pool) {
+        if (slot.state != SlotState::Free) {
+            wakeAt = std::min(wakeAt, slot.deadline);
+        }
+    }
+    if (wakeAt != steady_clock::time_point::max()) {
+        long untilDeadline = std::chrono::duration_cast<milliseconds>(wakeAt - now).count() + 1;
+        if (timeoutMs < 0 || untilDeadline < timeoutMs) {
+            timeoutMs = untilDeadline > 0 ? untilDeadline : 0;
+        }
+    }
+
+    struct epoll_event events[8];
+    if (epoll_wait(epollFd, events, 8, timeoutMs) < 0 && errno != EINTR) {
+        lastError = std::string("Error in epoll_wait: ") + strerror(errno);
+        return -1;
+    }
+
+    int completed = 0;
+    if (racing) {
+        completed += advanceRace();
+        if (sockfd < 0) {
+            return completed;  // Still racing, or lost
+        }
+    }
+    char buffer[CALC_BULK_MAX_DATAGRAM];
+    while (true) {
+        ssize_t len = recv(sockfd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == ECONNREFUSED || errno == EINTR) {
+                continue;
+            }
+            lastError = std::string("Failed to receive: ") + strerror(errno);
+            return -1;
+        }
+        completed += handleDatagram(buffer, len);
+    }
+
+    return completed + handleTimeouts();
+}
+
+bool calcCompute(calcProtocol& response) {
+    int arith = ntohl(response.arith);
+    int intValue1 = ntohl(response.inValue1);
+    int intValue2 = ntohl(response.inValue2);
+    double flValue1 = response.flValue1;
+    double flValue2 = response.flValue2;
+
+    // Perform the calculation based on the arithmetic operation code
+    switch (arith) {
+        case 1:  // Addition
+            response.inResult = htonl(intValue1 + intValue2);
+            break;
+        case 2:  // Subtraction
+            response.inResult = htonl(intValue1 - intValue2);
+            break;
+        case 3:  // Multiplication
+            response.inResult = htonl(intValue1 * intValue2);
+            break;
+        case 4:  // Division
+            if (intValue2 == 0) {
+                return false;
+            }
+            response.inResult = htonl(intValue1 / intValue2);
+            break;
+        case 5:  // Floating-point Addition
+            response.flResult = flValue1 + flValue2;
+            break;
+        case 6:  // Floating-point Subtraction
+            response.flResult = flValue1 - flValue2;
+            break;
+        case 7:  // Floating-point Multiplication
+            response.flResult = flValue1 * flValue2;
+            break;
+        case 8:  // Floating-point Division
+            if (flValue2 == 0.0) {
+                return false;
+            }
+            response.flResult = flValue1 / flValue2;
+            break;
+        default:
+            return false;
+    }
+
+    // Update response message for sending back to the server
+    response.type = htons(2);
+    response.major_version = htons(1);
+    response.minor_version = htons(0);
+    return true;
+}
+
+bool calcComputeBulk(const char* assignment, size_t len, std::vector<char>& result) {
+    calcBulkProtocol header;
+    if (len < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, assignment, sizeof(header));
+    int arith = ntohl(header.arith);
+    int n = ntohl(header.count);
+    if (arith < 9 || arith > 16 || n < 1 || n > CALC_BULK_MAX) {
+        return false;
+    }
+
+    size_t operands = CALC_BULK_IS_SUM(arith) ? 1 : 2;
+    size_t results = CALC_BULK_IS_ELEMENTWISE(arith) ? n : 1;
+    size_t elementSize = CALC_BULK_IS_FLOAT(arith) ? sizeof(double) : sizeof(int32_t);
+    if (len != sizeof(header) + operands * n * elementSize) {
+        return false;
+    }
+    const char* payload = assignment + sizeof(header);
+
+    header.type = htons(12);  // Bulk client to server
+    result.resize(sizeof(header) + results * elementSize);
+    memcpy(result.data(), &header, sizeof(header));
+    char* out = result.data() + sizeof(header);
+
+    if (!CALC_BULK_IS_FLOAT(arith)) {
+        // Operands arrive in network byte order; swap them into aligned scratch.
+        std::vector<int32_t> in(operands * n), res(results);
+        calcVecSwapInt(in.data(), (const int32_t*)payload, operands * n);
+        const int32_t* a = in.data();
+        const int32_t* b = a + n;
+        switch (arith) {
+            case 9: calcVecAddInt(a, b, res.data(), n); break;
+            case 10: calcVecMulInt(a, b, res.data(), n); break;
+            case 11: res[0] = calcVecDotInt(a, b, n); break;
+            case 12: res[0] = calcVecSumInt(a, n); break;
+        }
+        calcVecSwapInt((int32_t*)out, res.data(), results);
+        return true;
+    }
+
+    std::vector<double> in(operands * n), res(results);
+    memcpy(in.data(), payload, operands * n * sizeof(double));
+    const double* a = in.data();
+    const double* b = a + n;
+    switch (arith) {
+        case 13: calcVecAddFloat(a, b, res.data(), n); break;
+        case 14: calcVecMulFloat(a, b, res.data(), n); break;
+        case 15: res[0] = calcVecDotFloat(a, b, n); break;
+        case 16: res[0] = calcVecSumFloat(a, n); break;
+    }
+    memcpy(out, res.data(), results * sizeof(double));
+    return true;
+}
+
+const char* calcArithName(int arith) {
+    static const char* names[] = {"add", "sub", "mul", "div", "fadd", "fsub", "fmul", "fdiv",
+                                  "vadd", "vmul", "vdot", "vsum", "fvadd", "fvmul", "fvdot", "fvsum"};
+    if (arith < 1 || arith > 16) {
+        return "?";
+    }
+    return names[arith - 1];
+}
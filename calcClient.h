@@ -0,0 +1,181 @@
+#ifndef __CALC_CLIENT
+#define __CALC_CLIENT
+
+/*
+
+libcalcclient: an embeddable, asynchronous client for the calc protocol.
+
+A CalcClient owns one connected UDP socket and a fixed pool of session slots.
+Each submit() starts one assignment session (hello -> assignment -> result ->
+verdict) and completes it through a callback or a future. Apart from name
+resolution (getaddrinfo), nothing in here blocks unless the caller asks
+poll() to wait, and nothing calls exit(); every failure is reported as a
+CalcStatus or through error().
+
+The library does not run threads of its own, the caller drives it with poll().
+fd() can be added to the caller's own event loop; it becomes readable
+whenever poll() has replies to handle.
+
+open() returns at once and starts racing the resolved addresses
+Happy-Eyeballs style (RFC 8305), driven by poll(): the first hello goes to
+the preferred address, and every raceDelay the next address (alternating
+IPv6/IPv4) joins in. The first address to answer with an assignment wins and
+the socket is connected to it. Sessions submitted meanwhile wait for the
+race; the first of them gets the winning assignment, so a cold start costs
+one round trip. If no address answers within maxRetries * retryTimeout, the
+waiting sessions complete with CalcStatus::Timeout. With cachePath set,
+resolved addresses are kept on disk for cacheTtl, the winner first, so later
+runs skip DNS as well; the name is resolved afresh, and the new addresses
+join the race, if no cached address has answered after raceDelay.
+
+Besides UDP, a client can reach a server on the same host through its
+Unix-domain datagram socket (openUnix()); the messages are identical.
+
+With requestBulk set, sessions ask for protocol 1.1 bulk assignments
+(calcBulkProtocol, see protocol.h), which are computed with the SIMD kernels
+in calcLib. Servers only answer those when started with --bulk-count; a
+server without it ignores the hello, so the session times out. Link with
+-lcalcclient -lcalc.
+
+The server's verdict (calcMessage) carries no id, so verdicts are matched to
+sessions in the order their results were sent.
+
+*/
+
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <sys/socket.h>
+
+#include "protocol.h"
+
+enum class CalcStatus {
+    Ok,        // Server accepted our result
+    NotOk,     // Server rejected our result
+    Timeout,   // No reply after maxRetries attempts
+    Error      // Socket error, bad assignment, or client closed
+};
+
+struct CalcSession {
+    CalcStatus status;
+    calcProtocol assignment;  // As received from the server, network byte order
+    calcProtocol result;      // As sent back to the server, network byte order
+    std::vector<char> bulkAssignment;  // Whole bulk datagram, if the session was bulk
+    std::vector<char> bulkResult;
+};
+
+class CalcClient {
+public:
+    typedef std::function<void(const CalcSession&)> Callback;
+
+    explicit CalcClient(size_t poolSize = 64);
+    ~CalcClient();
+
+    CalcClient(const CalcClient&) = delete;
+    CalcClient& operator=(const CalcClient&) = delete;
+
+    // Resolve host:port (or read it from the cache) and start racing the
+    // addresses with a first hello. Returns false only if there is nothing to
+    // race; later failures complete the waiting sessions.
+    bool open(const std::string& host, int port);
+    // Connect to a server's same-host Unix-domain datagram socket instead.
+    bool openUnix(const std::string& path);
+    // Fail every in-flight session with CalcStatus::Error and close the socket.
+    void close();
+
+    // Start a session. Returns false when the pool is exhausted or not open.
+    bool submit(Callback done);
+    // Same, but completes a future. An exhausted pool yields CalcStatus::Error.
+    std::future<CalcSession> submit();
+
+    // Handle replies and retransmissions, waiting at most timeoutMs for
+    // traffic (0 = do not wait). Returns the number of sessions completed,
+    // or -1 on a socket error.
+    int poll(int timeoutMs);
+
+    size_t inFlight() const { return pool.size() - freeSlots.size(); }
+    // Readable whenever poll() has work; stable from open() until close().
+    int fd() const { return epollFd; }
+    const std::string& error() const { return lastError; }
+
+    int maxRetries = 3;
+    std::chrono::milliseconds retryTimeout{2000};
+    bool requestBulk = false;  // Ask for bulk assignments in new sessions
+    std::chrono::milliseconds raceDelay{250};  // Head start of each address in the race
+    std::string cachePath;                     // On-disk resolution cache, empty = off
+    std::chrono::seconds cacheTtl{300};
+
+private:
+    enum class SlotState { Free, AwaitAssignment, AwaitVerdict };
+
+    struct Slot {
+        SlotState state = SlotState::Free;
+        int attempts = 0;
+        uint64_t seq = 0;  // Order the current request was first sent in
+        std::chrono::steady_clock::time_point deadline;
+        CalcSession session;
+        Callback done;
+    };
+
+    struct Candidate {
+        sockaddr_storage addr;
+        socklen_t addrLen;
+        int fd = -1;
+        int attempts = 0;
+        bool failed = false;
+        bool resolved = false;  // Returned by DNS in this race, not just the cache
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    // State of the address race between open() and the first assignment.
+    struct Race {
+        std::string host;
+        int port = 0;
+        std::vector<Candidate> candidates;
+        size_t started = 0;           // Candidates that have been sent a hello
+        bool cached = false;          // Started from the resolution cache
+        bool resolvePending = false;  // Cached addresses only so far; resolve at resolveAt
+        int lastErrno = 0;
+        std::chrono::steady_clock::time_point nextStart, resolveAt, deadline;
+    };
+
+    bool resolve(const std::string& host, int port, std::vector<Candidate>& candidates);
+    void watch(int fd);
+    int advanceRace();
+    int finishRace(size_t winner, const char* buffer, ssize_t len);
+    int failRace();
+    std::chrono::steady_clock::time_point raceWakeAt() const;
+    bool sendSlot(Slot& slot);
+    int acceptAssignment(size_t index, const char* buffer, ssize_t len);
+    void complete(size_t index, CalcStatus status);
+    int handleDatagram(const char* buffer, ssize_t len);
+    int handleTimeouts();
+    long findOldest(SlotState state) const;
+
+    int sockfd = -1;
+    int epollFd = -1;
+    bool racing = false;
+    Race raceState;
+    uint64_t nextSeq = 0;
+    calcMessage hello;
+    std::vector<Slot> pool;
+    std::vector<size_t> freeSlots;
+    std::vector<char> firstAssignment;  // Won by the race, kept for the first submit()
+    std::chrono::steady_clock::time_point firstAssignmentAt;
+    std::string lastError;
+};
+
+// Fill in the result fields of an assignment (network byte order in and out).
+// Returns false for an unknown operation or a division by zero.
+bool calcCompute(calcProtocol& assignment);
+
+// Compute the result datagram for a bulk assignment datagram. Returns false
+// if the assignment is malformed.
+bool calcComputeBulk(const char* assignment, size_t len, std::vector<char>& result);
+
+// Name of an arith code ("add", "fdiv", ...), or "?" if unknown.
+const char* calcArithName(int arith);
+
+#endif
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <string.h>
 
 /* Here we use " as the calcLib.c and calcLib.h files are in the same folder, and are to be BUILT
    to into a library, that will be included in other files. 
@@ -71,3 +72,209 @@ double randomFloat(void){
 };
 
 
+
+int randomBulkArith(void){
+  /* Bulk codes are contiguous, 9 (vadd) to 16 (fvsum), see protocol.h */
+  return( 9 + rand()%8 );
+};
+
+
+void randomIntArray(int32_t *out, int n){
+  int i;
+  for(i=0;i<n;i++){
+    out[i]=randomInt();
+  }
+};
+
+
+void randomFloatArray(double *out, int n){
+  int i;
+  for(i=0;i<n;i++){
+    out[i]=randomFloat();
+  }
+};
+
+
+/* 
+   Bulk kernels. These use GCC vector extensions, so the compiler emits SSE2 on x86-64 and NEON on 
+   ARM without any intrinsics. Loads and stores go through memcpy() as the arrays may sit unaligned 
+   inside a datagram; the tail that does not fill a whole vector is done one element at a time.
+
+   The integer vectors are unsigned so that overflow wraps instead of being undefined.
+*/
+typedef uint32_t calc_v4su __attribute__((vector_size(16)));
+typedef double calc_v2df __attribute__((vector_size(16)));
+
+#define CALC_V4 4
+#define CALC_V2 2
+
+
+void calcVecAddInt(const int32_t *a, const int32_t *b, int32_t *out, int n){
+  int i=0;
+  calc_v4su x,y;
+  for(;i+CALC_V4<=n;i+=CALC_V4){
+    memcpy(&x,a+i,sizeof(x));
+    memcpy(&y,b+i,sizeof(y));
+    x+=y;
+    memcpy(out+i,&x,sizeof(x));
+  }
+  for(;i<n;i++){
+    out[i]=(int32_t)((uint32_t)a[i]+(uint32_t)b[i]);
+  }
+};
+
+
+void calcVecMulInt(const int32_t *a, const int32_t *b, int32_t *out, int n){
+  int i=0;
+  calc_v4su x,y;
+  for(;i+CALC_V4<=n;i+=CALC_V4){
+    memcpy(&x,a+i,sizeof(x));
+    memcpy(&y,b+i,sizeof(y));
+    x*=y;
+    memcpy(out+i,&x,sizeof(x));
+  }
+  for(;i<n;i++){
+    out[i]=(int32_t)((uint32_t)a[i]*(uint32_t)b[i]);
+  }
+};
+
+
+int32_t calcVecDotInt(const int32_t *a, const int32_t *b, int n){
+  int i=0;
+  calc_v4su x,y,acc={0,0,0,0};
+  uint32_t sum;
+  for(;i+CALC_V4<=n;i+=CALC_V4){
+    memcpy(&x,a+i,sizeof(x));
+    memcpy(&y,b+i,sizeof(y));
+    acc+=x*y;
+  }
+  sum=acc[0]+acc[1]+acc[2]+acc[3];
+  for(;i<n;i++){
+    sum+=(uint32_t)a[i]*(uint32_t)b[i];
+  }
+  return((int32_t)sum);
+};
+
+
+int32_t calcVecSumInt(const int32_t *a, int n){
+  int i=0;
+  calc_v4su x,acc={0,0,0,0};
+  uint32_t sum;
+  for(;i+CALC_V4<=n;i+=CALC_V4){
+    memcpy(&x,a+i,sizeof(x));
+    acc+=x;
+  }
+  sum=acc[0]+acc[1]+acc[2]+acc[3];
+  for(;i<n;i++){
+    sum+=(uint32_t)a[i];
+  }
+  return((int32_t)sum);
+};
+
+
+void calcVecAddFloat(const double *a, const double *b, double *out, int n){
+  int i=0;
+  calc_v2df x,y;
+  for(;i+CALC_V2<=n;i+=CALC_V2){
+    memcpy(&x,a+i,sizeof(x));
+    memcpy(&y,b+i,sizeof(y));
+    x+=y;
+    memcpy(out+i,&x,sizeof(x));
+  }
+  for(;i<n;i++){
+    out[i]=a[i]+b[i];
+  }
+};
+
+
+void calcVecMulFloat(const double *a, const double *b, double *out, int n){
+  int i=0;
+  calc_v2df x,y;
+  for(;i+CALC_V2<=n;i+=CALC_V2){
+    memcpy(&x,a+i,sizeof(x));
+    memcpy(&y,b+i,sizeof(y));
+    x*=y;
+    memcpy(out+i,&x,sizeof(x));
+  }
+  for(;i<n;i++){
+    out[i]=a[i]*b[i];
+  }
+};
+
+
+/* The reductions keep two vector accumulators, so the summation order differs from a plain 
+   loop. Results are therefore only equal within a tolerance to a scalar reference. */
+double calcVecDotFloat(const double *a, const double *b, int n){
+  int i=0;
+  calc_v2df x,y,acc0={0,0},acc1={0,0};
+  double sum;
+  for(;i+2*CALC_V2<=n;i+=2*CALC_V2){
+    memcpy(&x,a+i,sizeof(x));
+    memcpy(&y,b+i,sizeof(y));
+    acc0+=x*y;
+    memcpy(&x,a+i+CALC_V2,sizeof(x));
+    memcpy(&y,b+i+CALC_V2,sizeof(y));
+    acc1+=x*y;
+  }
+  acc0+=acc1;
+  sum=acc0[0]+acc0[1];
+  for(;i<n;i++){
+    sum+=a[i]*b[i];
+  }
+  return(sum);
+};
+
+
+double calcVecSumFloat(const double *a, int n){
+  int i=0;
+  calc_v2df x,acc0={0,0},acc1={0,0};
+  double sum;
+  for(;i+2*CALC_V2<=n;i+=2*CALC_V2){
+    memcpy(&x,a+i,sizeof(x));
+    acc0+=x;
+    memcpy(&x,a+i+CALC_V2,sizeof(x));
+    acc1+=x;
+  }
+  acc0+=acc1;
+  sum=acc0[0]+acc0[1];
+  for(;i<n;i++){
+    sum+=a[i];
+  }
+  return(sum);
+};
+
+
+void calcVecSwapInt(int32_t *out, const int32_t *in, int n){
+  /* Same job as htonl()/ntohl() on a whole array; the loop is simple enough for GCC to vectorize. */
+  int i;
+  uint32_t v;
+  for(i=0;i<n;i++){
+    memcpy(&v,in+i,sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v=__builtin_bswap32(v);
+#endif
+    memcpy(out+i,&v,sizeof(v));
+  }
+};
+
+
+int calcVecCloseFloat(const double *a, const double *b, int n, double tolerance){
+  int i=0;
+  calc_v2df x,y,d;
+  for(;i+CALC_V2<=n;i+=CALC_V2){
+    memcpy(&x,a+i,sizeof(x));
+    memcpy(&y,b+i,sizeof(y));
+    d=x-y;
+    /* Written so that a NaN difference also fails */
+    if(!(d[0]<tolerance && -d[0]<tolerance && d[1]<tolerance && -d[1]<tolerance)){
+      return(0);
+    }
+  }
+  for(;i<n;i++){
+    d[0]=a[i]-b[i];
+    if(!(d[0]<tolerance && -d[0]<tolerance)){
+      return(0);
+    }
+  }
+  return(1);
+};
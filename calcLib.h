@@ -5,6 +5,8 @@ extern "C"{
 #ifndef __CALC_LIB
 #define __CALC_LIB
 
+#include <stdint.h>
+
 /* 
 
 This is the header file for the calcLib. It is a C library.
@@ -27,6 +29,26 @@ Implementation in calcLib.c
   int randomInt(void);// Return a random integer, between 0 and 100. 
   double randomFloat(void);// Return a random float between 0.0 and 100.0
 
+  int randomBulkArith(void); // Return a random bulk arith code, 9..16 (see protocol.h)
+  void randomIntArray(int32_t* out, int n); // Fill out[0..n-1] with randomInt() values
+  void randomFloatArray(double* out, int n); // Fill out[0..n-1] with randomFloat() values
+
+  /* 
+     SIMD kernels for the bulk assignments. All arrays are in host byte order and 
+     need not be aligned. Integer arithmetic wraps modulo 2^32. 
+  */
+  void calcVecAddInt(const int32_t* a, const int32_t* b, int32_t* out, int n);
+  void calcVecMulInt(const int32_t* a, const int32_t* b, int32_t* out, int n);
+  int32_t calcVecDotInt(const int32_t* a, const int32_t* b, int n);
+  int32_t calcVecSumInt(const int32_t* a, int n);
+  void calcVecAddFloat(const double* a, const double* b, double* out, int n);
+  void calcVecMulFloat(const double* a, const double* b, double* out, int n);
+  double calcVecDotFloat(const double* a, const double* b, int n);
+  double calcVecSumFloat(const double* a, int n);
+
+  void calcVecSwapInt(int32_t* out, const int32_t* in, int n); // Network <-> host order, either way
+  int calcVecCloseFloat(const double* a, const double* b, int n, double tolerance); // 1 if all |a-b| < tolerance
+
 
 #endif
 
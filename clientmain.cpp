@@ -2,39 +2,30 @@
 #include <cstdlib>
 #include <cstring>
 #include <arpa/inet.h>
-#include <netdb.h>
-#include <sys/socket.h>
-#include <unistd.h>
-#include <sys/time.h>
 #include "protocol.h"
+#include "calcClient.h"
 #include <cstdio>
 // #define DEBUG
 
 // Function to print usage and exit
 void printUsageAndExit() {
-    std::cerr << "Usage: ./client <IP/DNS>:<Port>" << std::endl;
+    std::cerr << "Usage: ./client <IP/DNS>:<Port> | unix:<path> [--cache <file>] [--cache-ttl <seconds>]" << std::endl;
     exit(EXIT_FAILURE);
 }
-// Function to check and print "NOT OK" message
-bool isNotOkMessage(const calcMessage& response) { 
-    if (ntohs(response.type) == 2 && ntohl(response.message) == 2 &&
-        ntohs(response.major_version) == 1 && ntohs(response.minor_version) == 0) {
-        std::cerr << "Server sent a 'NOT OK' message. Terminating client." << std::endl;
-        return true;
-    }
-    return false;
-}
-
 
 // Function to split the input into IP and port
 bool parseIpPort(const std::string& input, std::string& ip, int& port) {
 
-    size_t delimiterPos = input.find(':');
+    // Split at the last ':' so IPv6 literals work, optionally as [addr]:port
+    size_t delimiterPos = input.rfind(':');
     if (delimiterPos == std::string::npos) {
         return false; // ':' not found
     }
 
     ip = input.substr(0, delimiterPos);
+    if (ip.size() > 2 && ip.front() == '[' && ip.back() == ']') {
+        ip = ip.substr(1, ip.size() - 2);
+    }
     std::string portStr = input.substr(delimiterPos + 1);
 
     try {
@@ -50,227 +41,89 @@ bool parseIpPort(const std::string& input, std::string& ip, int& port) {
 }
 
 
-void performCalculation(calcProtocol& response, int sockfd, struct addrinfo* res) {
-    int arith = ntohl(response.arith);
-    int intValue1 = ntohl(response.inValue1);
-    int intValue2 = ntohl(response.inValue2);
-    double flValue1 = response.flValue1;
-    double flValue2 = response.flValue2;
-
-    // Perform the calculation based on the arithmetic operation code
-    switch (arith) {
-        case 1:  // Addition
-            response.inResult = htonl(intValue1 + intValue2);
-            std::cout << "ASSIGNMENT: add " << intValue1 << " " << intValue2 << std::endl;
-            break;
-        case 2:  // Subtraction
-            response.inResult = htonl(intValue1 - intValue2);
-            std::cout << "ASSIGNMENT: sub " << intValue1 << " " << intValue2 << std::endl;
-            break;
-        case 3:  // Multiplication
-            response.inResult = htonl(intValue1 * intValue2);
-            std::cout << "ASSIGNMENT: mul " << intValue1 << " " << intValue2 << std::endl;
-            break;
-        case 4:  // Division
-            if (intValue2 != 0) {
-                response.inResult = htonl(intValue1 / intValue2);
-                std::cout << "ASSIGNMENT: div " << intValue1 << " " << intValue2 << std::endl;
-            } else {
-                std::cerr << "Division by zero error!" << std::endl;
-                return;
-            }
-            break;
-        case 5:  // Floating-point Addition
-            response.flResult = flValue1 + flValue2;
-            std::cout << "ASSIGNMENT: fadd " << flValue1 << " " << flValue2 << std::endl;
-            break;
-        case 6:  // Floating-point Subtraction
-            response.flResult = flValue1 - flValue2;
-            std::cout << "ASSIGNMENT: fsub " << flValue1 << " " << flValue2 << std::endl;
-            break;
-        case 7:  // Floating-point Multiplication
-            response.flResult = flValue1 * flValue2;
-            std::cout << "ASSIGNMENT: fmul " << flValue1 << " " << flValue2 << std::endl;
-            break;
-        case 8:  // Floating-point Division
-            if (flValue2 != 0.0) {
-                response.flResult = flValue1 / flValue2;
-                std::cout << "ASSIGNMENT: fdiv " << flValue1 << " " << flValue2 << std::endl;
-            } else {
-                std::cerr << "Division by zero error!" << std::endl;
-                return;
-            }
-            break;
-        default:
-            std::cerr << "Invalid arithmetic operation code: " << arith << std::endl;
-            return;
-    }
-
-#ifdef DEBUG
-    if (arith < 5) {
-        std::cout << "Calculated the result: " << ntohl(response.inResult) << std::endl;
-    } else {
-        std::cout << "Calculated the result: " << response.flResult << std::endl;
-    }
-#endif
-    // Update response message for sending back to the server
-    response.type = htons(2);
-    response.major_version = htons(1);
-    response.minor_version = htons(0);
-
-    const int maxRetries = 3;
-    const int timeoutSec = 2;
-    socklen_t addrLen = res->ai_addrlen;
-
-    for (int attempt = 1; attempt <= maxRetries; ++attempt) {
-        // Send the result to the server
-        ssize_t sentBytes = sendto(sockfd, &response, sizeof(response), 0, res->ai_addr, res->ai_addrlen);
-        if (sentBytes < 0) {
-            perror("Failed to send result to server");
-            exit(EXIT_FAILURE);
-        }
-
-        // Set up timeout for receiving confirmation
-        struct timeval timeout;
-        timeout.tv_sec = timeoutSec;
-        timeout.tv_usec = 0;
-
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(sockfd, &readfds);
-
-        // Wait for server's confirmation
-        int selectResult = select(sockfd + 1, &readfds, nullptr, nullptr, &timeout);
-        if (selectResult > 0 && FD_ISSET(sockfd, &readfds)) {
-            // Receive server's response
-            calcMessage serverResponse;
-            ssize_t receivedBytes = recvfrom(sockfd, &serverResponse, sizeof(serverResponse), 0, res->ai_addr, &addrLen);
-            if (receivedBytes > 0) {
-                int serverMessage = ntohl(serverResponse.message);
-                if (serverMessage == 1) {
-                    if (arith < 5) {
-                        std::cout << "OK (myresult=" << ntohl(response.inResult) << ")" << std::endl;
-                    } else {
-                        std::cout << "OK (myresult=" << response.flResult << ")" << std::endl;
-                    }
-                    return; 
-                } else {
-                    std::cout << "NOT OK" << std::endl;
-                }
-            } else {
-                perror("Failed to receive server's response");
-                exit(EXIT_FAILURE);
-            }
-        } else if (selectResult == 0) {
-            continue;
-        } else {
-            perror("Error while waiting for server's response");
-            exit(EXIT_FAILURE);
-        }
-    }
-
-    std::cerr << "No response from server after " << maxRetries << " attempts. Exiting." << std::endl;
-    exit(EXIT_FAILURE);
-}
-
-
-// Function to send and receive message with retry
-bool sendAndReceiveWithRetry(int sockfd, struct addrinfo* res, calcMessage& message, calcProtocol& response) {
-    const int maxRetries = 3;
-    const int timeoutSec = 2;
-    socklen_t addrLen = res->ai_addrlen;
-
-    for (int attempt = 1; attempt <= maxRetries; ++attempt) {
-        // Send the message
-        ssize_t sentBytes = sendto(sockfd, &message, sizeof(message), 0, res->ai_addr, res->ai_addrlen);
-        if (sentBytes < 0) {
-            perror("Failed to send message");
-            return false;
-        }
-
-        // Set up timeout for receiving
-        struct timeval timeout;
-        timeout.tv_sec = timeoutSec;
-        timeout.tv_usec = 0;
-
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(sockfd, &readfds);
-
-        // Wait for response with timeout
-        int selectResult = select(sockfd + 1, &readfds, nullptr, nullptr, &timeout);
-        if (selectResult > 0 && FD_ISSET(sockfd, &readfds)) {
-            // Receive the response from the server
-            ssize_t receivedBytes = recvfrom(sockfd, &response, sizeof(response), 0, res->ai_addr, &addrLen);
-            if (receivedBytes > 0) {
-                return true;  // Successfully received the response
-            } else {
-                perror("Failed to receive response");
-            }
-        } else if (selectResult < 0) {
-            perror("Error in select");
-            return false;
-        }
-    }
-
-    std::cerr << "No response from server after " << maxRetries << " attempts. Terminating." << std::endl;
-    return false;  // No response after maximum retries
-}
-
 int main(int argc, char *argv[]) {
     // Validate input and print usage.
-    if (argc != 2) {
+    if (argc < 2 || argc % 2 != 0) {
         printUsageAndExit();
     }
 
     std::string serverAddress, ip;
     int port;
 
+    CalcClient client(1);
+    bool opened;
+
+    for (int i = 2; i < argc; i += 2) {
+        std::string opt(argv[i]);
+        if (opt == "--cache") {
+            client.cachePath = argv[i + 1];
+        } else if (opt == "--cache-ttl") {
+            client.cacheTtl = std::chrono::seconds(atoi(argv[i + 1]));
+        } else {
+            printUsageAndExit();
+        }
+    }
+
     serverAddress = argv[1];
-    if (!parseIpPort(serverAddress, ip, port)) {
+    if (serverAddress.compare(0, 5, "unix:") == 0) {
+        opened = client.openUnix(serverAddress.substr(5));
+    } else if (parseIpPort(serverAddress, ip, port)) {
+        opened = client.open(ip, port);
+    } else {
         std::cerr << "Invalid input format. Expected <IP>:<Port>." << std::endl;
         printUsageAndExit();
     }
 
-    // Resolve the address (IPv4, IPv6, and DNS)
-    struct addrinfo hints{}, *res;
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_DGRAM;
-
-    int status = getaddrinfo(ip.c_str(), std::to_string(port).c_str(), &hints, &res);
-    if (status != 0) {
-        std::cerr << "Error resolving address: " << gai_strerror(status) << std::endl;
-        exit(EXIT_FAILURE);
-    }
-
-    // Create a UDP socket
-    int sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-    if (sockfd < 0) {
-        perror("Socket creation failed");
-        freeaddrinfo(res);
+    if (!opened) {
+        std::cerr << client.error() << std::endl;
         exit(EXIT_FAILURE);
     }
 
-    // Prepare the initial calcMessage to send to the server
-    calcMessage message;
-    memset(&message, 0, sizeof(message));
-    message.type = htons(22);             // Client-to-server binary protocol
-    message.message = htonl(0);           // First message
-    message.protocol = htons(17);         // UDP protocol
-    message.major_version = htons(1);     // Protocol version 1.0
-    message.minor_version = htons(0);
-
-    // Prepare the response buffer and message count
-    calcProtocol response;
+    bool done = false;
+    int exitCode = EXIT_FAILURE;
+    client.submit([&](const CalcSession& session) {
+        done = true;
+        int arith = ntohl(session.assignment.arith);
+        if (session.status == CalcStatus::Ok || session.status == CalcStatus::NotOk) {
+            if (arith < 5) {
+                std::cout << "ASSIGNMENT: " << calcArithName(arith) << " " << (int)ntohl(session.assignment.inValue1)
+                          << " " << (int)ntohl(session.assignment.inValue2) << std::endl;
+            } else {
+                std::cout << "ASSIGNMENT: " << calcArithName(arith) << " " << session.assignment.flValue1
+                          << " " << session.assignment.flValue2 << std::endl;
+            }
+#ifdef DEBUG
+            if (arith < 5) {
+                std::cout << "Calculated the result: " << (int)ntohl(session.result.inResult) << std::endl;
+            } else {
+                std::cout << "Calculated the result: " << session.result.flResult << std::endl;
+            }
+#endif
+        }
+        switch (session.status) {
+            case CalcStatus::Ok:
+                if (arith < 5) {
+                    std::cout << "OK (myresult=" << (int)ntohl(session.result.inResult) << ")" << std::endl;
+                } else {
+                    std::cout << "OK (myresult=" << session.result.flResult << ")" << std::endl;
+                }
+                exitCode = EXIT_SUCCESS;
+                break;
+            case CalcStatus::NotOk:
+                std::cout << "NOT OK" << std::endl;
+                break;
+            default:
+                std::cerr << client.error() << ". Terminating." << std::endl;
+                break;
+        }
+    });
 
-    // Attempt to send and receive response with retries
-    if (sendAndReceiveWithRetry(sockfd, res, message, response)) {
-        performCalculation(response, sockfd, res);
+    while (!done) {
+        if (client.poll(-1) < 0) {
+            std::cerr << client.error() << std::endl;
+            break;
+        }
     }
 
-    // Clean up
-    close(sockfd);
-    freeaddrinfo(res);
-
-    return 0;
+    return exitCode;
 }
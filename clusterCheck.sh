@@ -0,0 +1,24 @@
+#!/bin/sh
+# Start two linked server nodes on loopback and check that results sent to
+# the node that did not issue the assignment are forwarded and answered from
+# the address they were sent to. Extra arguments are passed to both nodes,
+# e.g. ./clusterCheck.sh --workers 2
+
+BASE=${CLUSTER_PORT:-5700}
+N0=127.0.0.1:$BASE
+N1=127.0.0.1:$((BASE + 1))
+L0=127.0.0.1:$((BASE + 10))
+L1=127.0.0.1:$((BASE + 11))
+
+./server $N0 --node 0 --link $L0 --peer 1=$L1 "$@" > /dev/null &
+P0=$!
+./server $N1 --node 1 --link $L1 --peer 0=$L0 "$@" > /dev/null &
+P1=$!
+trap 'kill $P0 $P1 2> /dev/null' EXIT
+sleep 1
+if ! kill -0 $P0 $P1 2> /dev/null; then
+    echo "A node failed to start" >&2
+    exit 1
+fi
+
+./clustercheck $N0 $N1 200 && ./clustercheck $N1 $N0 200
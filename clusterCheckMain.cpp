@@ -0,0 +1,148 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include "protocol.h"
+#include "calcClient.h"
+
+/*
+   Cluster forwarding check.
+
+   ./clustercheck <hello IP:port> <result IP:port> [sessions]
+
+   Runs scalar sessions that send the hello to one node and the result to
+   another, so every result has to be forwarded to the node that owns the
+   session. A session passes only if the verdict is OK and comes back from the
+   address the result was sent to. Assignments that cannot be computed
+   (division by zero) are skipped. Exits with 2 if any session failed.
+   clusterCheck.sh starts two linked nodes on loopback and runs this both ways.
+*/
+
+static bool resolve(const std::string& arg, sockaddr_storage& addr, socklen_t& addrLen) {
+    size_t colonPos = arg.rfind(':');
+    if (colonPos == std::string::npos) {
+        return false;
+    }
+    std::string host = arg.substr(0, colonPos);
+    if (host.size() > 1 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host.c_str(), arg.c_str() + colonPos + 1, &hints, &res) != 0) {
+        return false;
+    }
+    memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    addrLen = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+static std::string addrString(const sockaddr_storage& addr, socklen_t addrLen) {
+    char host[NI_MAXHOST], port[NI_MAXSERV];
+    if (getnameinfo((const struct sockaddr*)&addr, addrLen, host, sizeof(host), port, sizeof(port),
+                    NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        return "?";
+    }
+    return std::string(host) + ":" + port;
+}
+
+// Send one datagram to `to` and wait up to two seconds for the reply.
+static ssize_t exchange(int sockfd, const void* data, size_t len, const sockaddr_storage& to, socklen_t toLen,
+                        char* reply, size_t replySize, sockaddr_storage& from) {
+    if (sendto(sockfd, data, len, 0, (const struct sockaddr*)&to, toLen) < 0) {
+        perror("sendto");
+        return -1;
+    }
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(sockfd, &readfds);
+    struct timeval timeout = {2, 0};
+    if (select(sockfd + 1, &readfds, nullptr, nullptr, &timeout) <= 0) {
+        return -1;
+    }
+    socklen_t fromLen = sizeof(from);
+    return recvfrom(sockfd, reply, replySize, 0, (struct sockaddr*)&from, &fromLen);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || argc > 4) {
+        std::cerr << "Usage: " << argv[0] << " <hello IP:port> <result IP:port> [sessions]" << std::endl;
+        return 1;
+    }
+
+    sockaddr_storage helloAddr, resultAddr;
+    socklen_t helloAddrLen, resultAddrLen;
+    if (!resolve(argv[1], helloAddr, helloAddrLen) || !resolve(argv[2], resultAddr, resultAddrLen) ||
+        helloAddr.ss_family != resultAddr.ss_family) {
+        std::cerr << "Cannot resolve " << argv[1] << " and " << argv[2] << " to one address family" << std::endl;
+        return 1;
+    }
+    int sessions = argc > 3 ? std::atoi(argv[3]) : 100;
+
+    // Unconnected, so replies from either node are accepted and can be checked.
+    int sockfd = socket(helloAddr.ss_family, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    calcMessage hello;
+    hello.type = htons(22);
+    hello.message = htonl(0);
+    hello.protocol = htons(17);
+    hello.major_version = htons(1);
+    hello.minor_version = htons(0);
+
+    std::string expectedFrom = addrString(resultAddr, resultAddrLen);
+    int ok = 0, failed = 0, skipped = 0;
+    for (int i = 0; i < sessions; i++) {
+        char reply[CALC_BULK_MAX_DATAGRAM];
+        sockaddr_storage from;
+        calcProtocol assignment;
+        ssize_t len = exchange(sockfd, &hello, sizeof(hello), helloAddr, helloAddrLen, reply, sizeof(reply), from);
+        if (len != sizeof(calcProtocol)) {
+            std::cerr << "Session " << i << ": no assignment from " << argv[1] << std::endl;
+            failed++;
+            continue;
+        }
+        memcpy(&assignment, reply, sizeof(assignment));
+        if (!calcCompute(assignment)) {
+            skipped++;
+            continue;
+        }
+
+        len = exchange(sockfd, &assignment, sizeof(assignment), resultAddr, resultAddrLen, reply, sizeof(reply), from);
+        calcMessage verdict;
+        if (len != sizeof(verdict)) {
+            std::cerr << "Session " << i << ": no verdict" << std::endl;
+            failed++;
+            continue;
+        }
+        memcpy(&verdict, reply, sizeof(verdict));
+        std::string verdictFrom = addrString(from, sizeof(from));
+        if (verdictFrom != expectedFrom) {
+            std::cerr << "Session " << i << ": verdict came from " << verdictFrom
+                      << ", expected " << expectedFrom << std::endl;
+            failed++;
+        } else if (ntohl(verdict.message) != 1) {
+            std::cerr << "Session " << i << ": NOT OK" << std::endl;
+            failed++;
+        } else {
+            ok++;
+        }
+    }
+    close(sockfd);
+
+    std::cout << argv[1] << " -> " << argv[2] << ": ok=" << ok << " failed=" << failed
+              << " skipped=" << skipped << std::endl;
+    return failed == 0 ? 0 : 2;
+}
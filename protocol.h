@@ -9,6 +9,9 @@
 #endif
 
 
+#ifndef __CALC_PROTOCOL
+#define __CALC_PROTOCOL
+
 #include <stdint.h>
 
 /* 
@@ -43,6 +46,35 @@ struct  __attribute__((__packed__)) calcMessage {
 };
 
 
+/* 
+   Bulk assignments, protocol version 1.1. A client that sends minor_version = 1 in its 
+   first calcMessage gets a calcBulkProtocol instead of a calcProtocol. The header is 
+   followed by the payload:
+
+   server->client (type 11): operand1[count], then operand2[count] unless arith is a sum
+   client->server (type 12): result[count] for vadd/vmul/fvadd/fvmul, a single result otherwise
+
+   Elements are int32_t (arith 9..12, conversion needed) or double (arith 13..16, no 
+   conversion, as for calcProtocol). The first fields line up with calcProtocol, so id 
+   sits at the same offset in both.
+ */
+#define CALC_BULK_MAX 2048
+
+struct  __attribute__((__packed__)) calcBulkProtocol{
+  uint16_t type;  // 11 = bulk server to client, 12 = bulk client to server, conversion needed 
+  uint16_t major_version; // 1, conversion needed 
+  uint16_t minor_version; // 1, conversion needed 
+  uint32_t id; // As in calcProtocol, conversion needed 
+  uint32_t arith; // Bulk operation, 9..16, see mapping below, conversion needed 
+  uint32_t count; // Elements per operand array, 1..CALC_BULK_MAX, conversion needed 
+};
+
+#define CALC_BULK_IS_FLOAT(arith) ((arith) >= 13)
+#define CALC_BULK_IS_SUM(arith) ((arith) == 12 || (arith) == 16)
+#define CALC_BULK_IS_ELEMENTWISE(arith) ((arith) == 9 || (arith) == 10 || (arith) == 13 || (arith) == 14)
+#define CALC_BULK_MAX_DATAGRAM (sizeof(struct calcBulkProtocol) + 2 * CALC_BULK_MAX * sizeof(double))
+
+
 /* arith mapping in calcProtocol
 1 - add
 2 - sub
@@ -53,6 +85,16 @@ struct  __attribute__((__packed__)) calcMessage {
 7 - fmul
 8 - fdiv
 
+arith mapping in calcBulkProtocol
+9 - vadd, element-wise add
+10 - vmul, element-wise multiply
+11 - vdot, dot product
+12 - vsum, sum of operand1
+13 - fvadd
+14 - fvmul
+15 - fvdot
+16 - fvsum
+
 other numbers are reserved
 
 */
@@ -74,3 +116,5 @@ other numbers are reserved
    2 = NOT OK  // Reject 
 
 */
+
+#endif
@@ -19,37 +19,147 @@
 #include <algorithm>
 #include <chrono>
 #include <map>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <cstddef>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
 #include "protocol.h"
+#include "xdpPath.h"
+#include "spscRing.h"
+
+// Operands of a bulk session in host byte order, kept for verification.
+struct BulkAssignment {
+    int arith = 0;  // 0 for a scalar session
+    uint32_t count = 0;
+    std::vector<int32_t> ints;   // operand1, then operand2 if present
+    std::vector<double> floats;
+};
 
 struct ClientInfo {
+    int fd;  // Socket the client talks to us on (UDP or Unix domain)
     sockaddr_storage addr;
     socklen_t addrLen;
-    int id;
+    uint32_t id;
     std::chrono::steady_clock::time_point lastActivity;
     calcProtocol assignment;
+    BulkAssignment bulk;
+};
+
+std::map<uint32_t, ClientInfo> clients;
+
+// Cluster mode: the top bits of every id name the node that issued it, so any
+// node can tell who owns a session. Results for ids owned by another node are
+// wrapped in a clusterForward header and sent to that node's internal link.
+// The owner sends its verdict back the same way, and the node that received
+// the result sends it on, so the client hears back from the address it used.
+const int kNodeShift = 24;
+const uint32_t kMaxNodes = 1u << (32 - kNodeShift);
+const uint32_t kForwardMagic = 0x43414c43;  // "CALC", a result for the owner
+const uint32_t kVerdictMagic = 0x43414c56;  // "CALV", a verdict for the origin
+
+struct __attribute__((__packed__)) clusterForward {
+    uint32_t magic;      // kForwardMagic or kVerdictMagic, conversion needed
+    uint32_t origin;     // Node that sent this packet, conversion needed
+    uint32_t addrLen;    // Length of clientAddr, conversion needed
+    sockaddr_storage clientAddr;  // The client the datagram came from or is for
+    // Followed by the client's datagram, or by the verdict for the client.
 };
 
-std::map<int, ClientInfo> clients;
+struct PeerInfo {
+    sockaddr_storage addr;
+    socklen_t addrLen;
+};
 
-int getRandomId() {
+struct ClusterConfig {
+    uint32_t node = 0;
+    int linkFd = -1;
+    std::map<uint32_t, PeerInfo> peers;
+};
+
+ClusterConfig cluster;
+
+// Bulk assignments (protocol 1.1) are only served with --bulk-count: a
+// 12-byte hello gets a reply of several kilobytes, so an open bulk server is a
+// reflection amplifier. Each source address may also hold only a few
+// bulk sessions at a time, as every one keeps its operands in memory.
+uint32_t bulkCount = 0;  // Elements per operand in bulk assignments, 0 = off
+const int kMaxBulkPerAddress = 128;
+std::map<std::string, int> bulkSessions;  // Open bulk sessions per client address
+
+XdpPath xdp;
+
+uint32_t ownerOf(uint32_t id) {
+    return id >> kNodeShift;
+}
+
+uint32_t getRandomId() {
     static std::random_device rd;
     static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<int> distribution(0, 10000);
+    static std::uniform_int_distribution<uint32_t> distribution(0, (1u << kNodeShift) - 1);
     
-    int randomId;
+    uint32_t randomId;
     do {
-        randomId = distribution(gen);
+        randomId = (cluster.node << kNodeShift) | distribution(gen);
     } while (clients.find(randomId) != clients.end());
     
     return randomId;
 }
 
+// Split "host:port" at the last colon, so IPv6 literals like ::1:5000 work.
+bool splitHostPort(const std::string& arg, std::string& host, int& port) {
+    size_t colonPos = arg.rfind(':');
+    if (colonPos == std::string::npos) {
+        return false;
+    }
+    host = arg.substr(0, colonPos);
+    try {
+        port = std::stoi(arg.substr(colonPos + 1));
+    } catch (...) {
+        return false;
+    }
+    return port > 0 && port <= 65535;
+}
+
+bool resolveAddress(const std::string& host, int port, sockaddr_storage& addr, socklen_t& addrLen) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0) {
+        return false;
+    }
+    memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    addrLen = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+std::string addressKey(const sockaddr_storage& addr, socklen_t addrLen) {
+    return std::string((const char*)&addr, addrLen);
+}
+
+std::map<uint32_t, ClientInfo>::iterator eraseClient(std::map<uint32_t, ClientInfo>::iterator it) {
+    if (it->second.bulk.arith != 0) {
+        auto count = bulkSessions.find(addressKey(it->second.addr, it->second.addrLen));
+        if (count != bulkSessions.end() && --count->second == 0) {
+            bulkSessions.erase(count);
+        }
+    }
+    return clients.erase(it);
+}
+
 void removeInactiveClients() {
     auto now = std::chrono::steady_clock::now();
     for (auto it = clients.begin(); it != clients.end();) {
         if (std::chrono::duration_cast<std::chrono::seconds>(now - it->second.lastActivity).count() > 10) {
             std::cout << "Client " << it->first << " timed out and removed" << std::endl;
-            it = clients.erase(it);
+            it = eraseClient(it);
         } else {
             ++it;
         }
@@ -96,11 +206,49 @@ int setupSocket(const char* ip, int port) {
     return sockfd;
 }
 
-calcProtocol generateAssignment() {
+// Same-host transport: a Unix-domain datagram socket carrying the exact same
+// calcMessage/calcProtocol structs as UDP. Clients must bind (or autobind) an
+// address of their own so that replies can reach them.
+int setupUnixSocket(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        std::cerr << "Unix socket path too long" << std::endl;
+        exit(1);
+    }
+    strcpy(addr.sun_path, path);
+    
+    int sockfd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (sockfd == -1) {
+        perror("socket");
+        exit(1);
+    }
+    
+    // Only clear away a stale socket from an earlier run, never anything else.
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            std::cerr << path << " exists and is not a socket" << std::endl;
+            exit(1);
+        }
+        unlink(path);
+    }
+    if (bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("Failed to bind Unix socket");
+        exit(1);
+    }
+    
+    std::cout << "Server listening on unix:" << path << std::endl;
+    return sockfd;
+}
+
+// Everything of an assignment except its id, already in network byte order.
+calcProtocol generateTemplate() {
     calcProtocol assignment;
+    memset(&assignment, 0, sizeof(assignment));
     assignment.major_version = htons(1);
     assignment.minor_version = htons(0);
-    assignment.id = htonl(getRandomId());
     assignment.type = htons(1);
     
     char* op = randomType();
@@ -124,6 +272,218 @@ calcProtocol generateAssignment() {
     return assignment;
 }
 
+// Upper bounds for --ring-depth and --queue-depth. Both rings are allocated up
+// front, and a larger ring only adds memory and latency.
+const size_t kMaxRingDepth = 1 << 20;
+const size_t kMaxQueueDepth = 1 << 16;
+
+// Keeps a ring of ready-to-send assignment templates topped up from a
+// background thread, so the receive path only has to stamp in an id.
+class AssignmentProducer {
+public:
+    explicit AssignmentProducer(size_t depth) : ring(depth) {}
+    
+    ~AssignmentProducer() {
+        stop();
+    }
+    
+    bool start() {
+        wakeFd = eventfd(0, 0);
+        if (wakeFd < 0) {
+            return false;
+        }
+        running = true;
+        thread = std::thread([this]() { run(); });
+        return true;
+    }
+    
+    void stop() {
+        running = false;
+        if (thread.joinable()) {
+            wake();
+            thread.join();
+        }
+        if (wakeFd >= 0) {
+            close(wakeFd);
+            wakeFd = -1;
+        }
+    }
+    
+    bool take(calcProtocol& assignment) {
+        if (!ring.pop(assignment)) {
+            underruns++;
+            return false;
+        }
+        // Wake a producer parked on a full ring once it has drained to half,
+        // so it refills in batches instead of once per assignment.
+        if (ring.size() <= ring.capacity() / 2) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiting.load(std::memory_order_relaxed) && waiting.exchange(false)) {
+                wake();
+            }
+        }
+        return true;
+    }
+    
+    size_t depth() const { return ring.size(); }
+    size_t capacity() const { return ring.capacity(); }
+    
+    std::atomic<uint64_t> refilled{0};
+    uint64_t underruns = 0;  // Only touched by the I/O thread
+    
+private:
+    void run() {
+        while (running) {
+            calcProtocol assignment = generateTemplate();
+            // A full ring means the I/O thread is keeping up; sleep on the
+            // eventfd until take() has drained it to the low-water mark.
+            while (!ring.push(assignment)) {
+                waiting = true;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                // Re-check after announcing, or a take() in between is missed.
+                if (ring.push(assignment)) {
+                    waiting = false;
+                    break;
+                }
+                if (!running) {
+                    return;
+                }
+                uint64_t count;
+                if (read(wakeFd, &count, sizeof(count)) < 0 && errno != EINTR) {
+                    perror("read");
+                    return;
+                }
+            }
+            refilled.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    
+    void wake() {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            perror("write");
+        }
+    }
+    
+    SpscRing<calcProtocol> ring;
+    std::atomic<bool> running{false};
+    std::atomic<bool> waiting{false};
+    int wakeFd = -1;
+    std::thread thread;
+};
+
+std::unique_ptr<AssignmentProducer> producer;
+
+calcProtocol generateAssignment() {
+    calcProtocol assignment;
+    if (!producer || !producer->take(assignment)) {
+        assignment = generateTemplate();
+    }
+    assignment.id = htonl(getRandomId());
+    return assignment;
+}
+
+// Build a bulk assignment datagram (protocol 1.1) and remember its operands.
+std::vector<char> generateBulkAssignment(BulkAssignment& bulk) {
+    bulk.arith = randomBulkArith();
+    bulk.count = bulkCount;
+    int operands = CALC_BULK_IS_SUM(bulk.arith) ? 1 : 2;
+    size_t elements = operands * bulk.count;
+    
+    calcBulkProtocol header;
+    header.type = htons(11);
+    header.major_version = htons(1);
+    header.minor_version = htons(1);
+    header.id = htonl(getRandomId());
+    header.arith = htonl(bulk.arith);
+    header.count = htonl(bulk.count);
+    
+    std::vector<char> datagram(sizeof(header));
+    memcpy(datagram.data(), &header, sizeof(header));
+    if (CALC_BULK_IS_FLOAT(bulk.arith)) {
+        bulk.floats.resize(elements);
+        randomFloatArray(bulk.floats.data(), elements);
+        datagram.resize(sizeof(header) + elements * sizeof(double));
+        memcpy(datagram.data() + sizeof(header), bulk.floats.data(), elements * sizeof(double));
+    } else {
+        bulk.ints.resize(elements);
+        randomIntArray(bulk.ints.data(), elements);
+        datagram.resize(sizeof(header) + elements * sizeof(int32_t));
+        calcVecSwapInt((int32_t*)(datagram.data() + sizeof(header)), bulk.ints.data(), elements);
+    }
+    return datagram;
+}
+
+bool verifyBulkResult(const BulkAssignment& bulk, const char* buffer, size_t len) {
+    calcBulkProtocol header;
+    if (bulk.arith == 0 || len < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, buffer, sizeof(header));
+    if ((int)ntohl(header.arith) != bulk.arith || ntohl(header.count) != bulk.count) {
+        return false;
+    }
+    
+    int n = bulk.count;
+    size_t results = CALC_BULK_IS_ELEMENTWISE(bulk.arith) ? n : 1;
+    size_t elementSize = CALC_BULK_IS_FLOAT(bulk.arith) ? sizeof(double) : sizeof(int32_t);
+    if (len != sizeof(header) + results * elementSize) {
+        return false;
+    }
+    const char* payload = buffer + sizeof(header);
+    
+    // Reused between calls so verification does not allocate per result.
+    static thread_local std::vector<int32_t> expectedInts, gotInts;
+    static thread_local std::vector<double> expectedFloats, gotFloats;
+    
+    if (!CALC_BULK_IS_FLOAT(bulk.arith)) {
+        const int32_t* a = bulk.ints.data();
+        const int32_t* b = a + n;
+        expectedInts.resize(results);
+        gotInts.resize(results);
+        calcVecSwapInt(gotInts.data(), (const int32_t*)payload, results);
+        switch (bulk.arith) {
+            case 9: calcVecAddInt(a, b, expectedInts.data(), n); break;
+            case 10: calcVecMulInt(a, b, expectedInts.data(), n); break;
+            case 11: expectedInts[0] = calcVecDotInt(a, b, n); break;
+            case 12: expectedInts[0] = calcVecSumInt(a, n); break;
+        }
+        return memcmp(expectedInts.data(), gotInts.data(), results * sizeof(int32_t)) == 0;
+    }
+    
+    const double* a = bulk.floats.data();
+    const double* b = a + n;
+    gotFloats.resize(results);
+    memcpy(gotFloats.data(), payload, results * sizeof(double));
+    switch (bulk.arith) {
+        case 13:
+        case 14:
+            expectedFloats.resize(n);
+            if (bulk.arith == 13) {
+                calcVecAddFloat(a, b, expectedFloats.data(), n);
+            } else {
+                calcVecMulFloat(a, b, expectedFloats.data(), n);
+            }
+            return calcVecCloseFloat(expectedFloats.data(), gotFloats.data(), n, 1e-6);
+        case 15:
+        case 16: {
+            // Reductions may legitimately be summed in a different order.
+            double expected = bulk.arith == 15 ? calcVecDotFloat(a, b, n) : calcVecSumFloat(a, n);
+            return std::abs(gotFloats[0] - expected) < 1e-9 * std::max(1.0, std::abs(expected));
+        }
+    }
+    return false;
+}
+
+bool isBulkResult(const char* buffer, ssize_t len) {
+    calcBulkProtocol header;
+    if (len < (ssize_t)sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, buffer, sizeof(header));
+    return ntohs(header.type) == 12;
+}
+
 bool verifyResult(const calcProtocol& assignment, const calcProtocol& result) {
     int op = ntohl(assignment.arith);
     if (op <= 4) {
@@ -150,81 +510,805 @@ bool verifyResult(const calcProtocol& assignment, const calcProtocol& result) {
     return false;
 }
 
+// Every reply to a client goes through here. While the AF_XDP path is handling
+// a frame, the reply to that frame's sender is written back into the frame;
+// anything else goes out through the kernel socket.
+void sendReply(int sockfd, const void* data, size_t len, const sockaddr_storage& addr, socklen_t addrLen) {
+    if (xdp.isOpen() && xdp.reply(data, len, addr)) {
+        return;
+    }
+    sendto(sockfd, data, len, 0, (struct sockaddr*)&addr, addrLen);
+}
+
+// Wrap a datagram in a clusterForward header and send it to a node's link.
+bool sendToNode(uint32_t node, uint32_t magic, const void* datagram, size_t len,
+                const sockaddr_storage& clientAddr, socklen_t clientAddrLen) {
+    auto peer = cluster.peers.find(node);
+    if (cluster.linkFd < 0 || peer == cluster.peers.end()) {
+        return false;
+    }
+    
+    char packet[sizeof(clusterForward) + CALC_BULK_MAX_DATAGRAM];
+    clusterForward header;
+    memset(&header, 0, sizeof(header));
+    header.magic = htonl(magic);
+    header.origin = htonl(cluster.node);
+    header.addrLen = htonl(clientAddrLen);
+    memcpy(&header.clientAddr, &clientAddr, clientAddrLen);
+    memcpy(packet, &header, sizeof(header));
+    memcpy(packet + sizeof(header), datagram, len);
+    
+    ssize_t sent = sendto(cluster.linkFd, packet, sizeof(header) + len, 0,
+                          (struct sockaddr*)&peer->second.addr, peer->second.addrLen);
+    return sent == (ssize_t)(sizeof(header) + len);
+}
+
+// Answer a client. `origin` is the node a forwarded result came in on, or -1
+// if it reached us directly; forwarded results are answered through that node.
+void replyToClient(int origin, int sockfd, const void* data, size_t len,
+                   const sockaddr_storage& addr, socklen_t addrLen) {
+    if (origin < 0) {
+        sendReply(sockfd, data, len, addr, addrLen);
+    } else if (!sendToNode(origin, kVerdictMagic, data, len, addr, addrLen)) {
+        std::cout << "No link back to node " << origin << std::endl;
+    }
+}
+
+void sendReject(int origin, int sockfd, const sockaddr_storage& addr, socklen_t addrLen) {
+    calcMessage errorResponse;
+    errorResponse.major_version = htons(1);
+    errorResponse.minor_version = htons(0);
+    errorResponse.protocol = htons(17);
+    errorResponse.type = htons(2);
+    errorResponse.message = htonl(2);  // NOT OK
+    replyToClient(origin, sockfd, &errorResponse, sizeof(errorResponse), addr, addrLen);
+}
+
+bool checkResult(const ClientInfo& client, const char* buffer, size_t len, bool bulkResult) {
+    if (bulkResult) {
+        return verifyBulkResult(client.bulk, buffer, len);
+    }
+    calcProtocol result;
+    memcpy(&result, buffer, sizeof(result));
+    return client.bulk.arith == 0 && verifyResult(client.assignment, result);
+}
+
+void sendVerdict(uint32_t clientId, bool correct, int origin, int sockfd,
+                 const sockaddr_storage& addr, socklen_t addrLen) {
+    calcMessage response;
+    response.major_version = htons(1);
+    response.minor_version = htons(0);
+    response.protocol = htons(17);
+    response.type = htons(2);
+    
+    if (correct) {
+        response.message = htonl(1);  // OK
+        std::cout << "Client " << clientId << " provided correct result" << std::endl;
+    } else {
+        response.message = htonl(2);  // NOT OK
+        std::cout << "Client " << clientId << " provided incorrect result" << std::endl;
+    }
+    replyToClient(origin, sockfd, &response, sizeof(response), addr, addrLen);
+}
+
+// A result on its way through the verification pipeline. The session leaves
+// the clients map when the job is made, so nothing else can touch it.
+struct VerifyJob {
+    ClientInfo client;
+    int origin = -1;
+    int replyFd = -1;
+    sockaddr_storage replyAddr;
+    socklen_t replyAddrLen;
+    std::vector<char> datagram;
+    bool bulkResult = false;
+    bool correct = false;
+    bool rejected = false;  // Held back NOT OK for an unknown session
+    uint64_t seq = 0;
+    std::string orderKey;
+    std::chrono::steady_clock::time_point enqueued, started, finished;
+};
+
+// Optional staged verification. The I/O thread keeps receiving, session
+// bookkeeping and sending; results are handed round-robin to worker threads,
+// each fed through its own single-producer ring, and verdicts come back
+// through a second ring per worker. Workers sleep on an eventfd and wake the
+// I/O thread through another one, which sits in its pselect() set.
+//
+// When every inbound ring is full the I/O thread stops reading its sockets
+// until verdicts drain, so the backlog stays in the kernel socket buffers;
+// results already read in that round are verified inline.
+//
+// Verdicts carry no id and clients match them to sessions in the order they
+// sent their results, so verdicts for one reply address are sent in arrival
+// order, whichever worker finishes first. Verdicts are sent after the frame
+// that carried the result has been released, so with --xdp they go out
+// through the kernel socket.
+class VerificationPipeline {
+public:
+    VerificationPipeline(int numWorkers, size_t depth) {
+        for (int i = 0; i < numWorkers; i++) {
+            workers.emplace_back(new Worker(depth));
+        }
+    }
+    
+    ~VerificationPipeline() {
+        stop();
+    }
+    
+    bool start() {
+        doneFd = eventfd(0, EFD_NONBLOCK);
+        if (doneFd < 0) {
+            return false;
+        }
+        running = true;
+        for (auto& worker : workers) {
+            worker->wakeFd = eventfd(0, 0);
+            if (worker->wakeFd < 0) {
+                return false;
+            }
+            Worker* w = worker.get();
+            worker->thread = std::thread([this, w]() { run(*w); });
+        }
+        return true;
+    }
+    
+    void stop() {
+        running = false;
+        for (auto& worker : workers) {
+            if (worker->thread.joinable()) {
+                wake(worker->wakeFd);
+                worker->thread.join();
+            }
+            if (worker->wakeFd >= 0) {
+                close(worker->wakeFd);
+                worker->wakeFd = -1;
+            }
+        }
+        if (doneFd >= 0) {
+            close(doneFd);
+            doneFd = -1;
+        }
+    }
+    
+    int fd() const { return doneFd; }
+    
+    void submit(VerifyJob& job) {
+        job.seq = nextSeq++;
+        job.orderKey = orderKey(job.origin, job.replyAddr, job.replyAddrLen);
+        order[job.orderKey].push_back(job.seq);
+        job.enqueued = std::chrono::steady_clock::now();
+        for (size_t tries = 0; tries < workers.size(); tries++) {
+            Worker& worker = *workers[next];
+            next = (next + 1) % workers.size();
+            if (worker.in.push(std::move(job))) {
+                worker.pending = true;
+                return;
+            }
+        }
+        overflow++;
+        job.started = std::chrono::steady_clock::now();
+        job.correct = checkResult(job.client, job.datagram.data(), job.datagram.size(), job.bulkResult);
+        job.finished = std::chrono::steady_clock::now();
+        complete(std::move(job));
+    }
+    
+    // Queue a reject behind the verdicts still pending for the same address.
+    // Returns false if there are none and it can be sent straight away.
+    bool holdReject(int origin, int sockfd, const sockaddr_storage& addr, socklen_t addrLen) {
+        std::string key = orderKey(origin, addr, addrLen);
+        auto pending = order.find(key);
+        if (pending == order.end()) {
+            return false;
+        }
+        VerifyJob job;
+        job.origin = origin;
+        job.replyFd = sockfd;
+        job.replyAddr = addr;
+        job.replyAddrLen = addrLen;
+        job.rejected = true;
+        job.seq = nextSeq++;
+        job.orderKey = key;
+        pending->second.push_back(job.seq);
+        finished.emplace(job.seq, std::move(job));
+        return true;
+    }
+    
+    // Wake the workers that got jobs since the last call, once per batch.
+    void flush() {
+        for (auto& worker : workers) {
+            if (worker->pending) {
+                worker->pending = false;
+                wake(worker->wakeFd);
+            }
+        }
+    }
+    
+    bool full() const {
+        for (auto& worker : workers) {
+            if (worker->in.size() < worker->in.capacity()) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // Send every verdict the workers have finished.
+    void drain() {
+        uint64_t count;
+        if (read(doneFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+            perror("read");
+        }
+        for (auto& worker : workers) {
+            VerifyJob job;
+            while (worker->out.pop(job)) {
+                complete(std::move(job));
+            }
+        }
+    }
+    
+    size_t inDepth() const { return depth(&Worker::in); }
+    size_t outDepth() const { return depth(&Worker::out); }
+    
+    // Per-stage latency since the stats were last printed.
+    struct StageStats {
+        uint64_t count = 0;
+        double totalUs = 0, maxUs = 0;
+        
+        void add(std::chrono::steady_clock::duration d) {
+            double us = std::chrono::duration<double, std::micro>(d).count();
+            count++;
+            totalUs += us;
+            maxUs = std::max(maxUs, us);
+        }
+        double avgUs() const { return count ? totalUs / count : 0; }
+        void reset() { *this = StageStats(); }
+    };
+    
+    StageStats queueWait, verify, returnWait;  // returnWait includes time held for ordering
+    uint64_t stalls = 0;    // pselect() rounds spent not reading because of backpressure
+    uint64_t overflow = 0;  // Results verified inline because every ring was full
+    
+private:
+    struct Worker {
+        explicit Worker(size_t depth) : in(depth), out(depth) {}
+        SpscRing<VerifyJob> in, out;
+        int wakeFd = -1;
+        bool pending = false;  // Only touched by the I/O thread
+        std::thread thread;
+    };
+    
+    static void wake(int efd) {
+        uint64_t one = 1;
+        if (write(efd, &one, sizeof(one)) < 0) {
+            perror("write");
+        }
+    }
+    
+    static std::string orderKey(int origin, const sockaddr_storage& addr, socklen_t addrLen) {
+        std::string key((const char*)&origin, sizeof(origin));
+        return key.append((const char*)&addr, addrLen);
+    }
+    
+    // Park a finished job, then send every verdict for its address that is
+    // no longer waiting on an earlier one.
+    void complete(VerifyJob&& job) {
+        std::string key = job.orderKey;
+        finished.emplace(job.seq, std::move(job));
+        
+        auto pending = order.find(key);
+        while (!pending->second.empty()) {
+            auto ready = finished.find(pending->second.front());
+            if (ready == finished.end()) {
+                break;
+            }
+            const VerifyJob& done = ready->second;
+            if (done.rejected) {
+                sendReject(done.origin, done.replyFd, done.replyAddr, done.replyAddrLen);
+            } else {
+                sendVerdict(done.client.id, done.correct, done.origin, done.replyFd, done.replyAddr, done.replyAddrLen);
+                queueWait.add(done.started - done.enqueued);
+                verify.add(done.finished - done.started);
+                returnWait.add(std::chrono::steady_clock::now() - done.finished);
+            }
+            finished.erase(ready);
+            pending->second.pop_front();
+        }
+        if (pending->second.empty()) {
+            order.erase(pending);
+        }
+    }
+    
+    size_t depth(SpscRing<VerifyJob> Worker::*ring) const {
+        size_t total = 0;
+        for (auto& worker : workers) {
+            total += ((*worker).*ring).size();
+        }
+        return total;
+    }
+    
+    void run(Worker& worker) {
+        VerifyJob job;
+        while (running) {
+            int unsignalled = 0;
+            while (worker.in.pop(job)) {
+                job.started = std::chrono::steady_clock::now();
+                job.correct = checkResult(job.client, job.datagram.data(), job.datagram.size(), job.bulkResult);
+                job.finished = std::chrono::steady_clock::now();
+                // The I/O thread is behind on sending. Tell it there are
+                // verdicts to drain before waiting for room: it may be
+                // blocked on backpressure, waiting for exactly that.
+                while (!worker.out.push(std::move(job))) {
+                    wake(doneFd);
+                    unsignalled = 0;
+                    if (!running) {
+                        return;
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                // Signal in small batches so a steady stream of jobs never
+                // keeps finished verdicts from the I/O thread.
+                if (++unsignalled == kWakeBatch) {
+                    wake(doneFd);
+                    unsignalled = 0;
+                }
+            }
+            if (unsignalled > 0) {
+                wake(doneFd);
+            }
+            uint64_t count;
+            if (read(worker.wakeFd, &count, sizeof(count)) < 0 && errno != EINTR) {
+                perror("read");
+                return;
+            }
+        }
+    }
+    
+    static const int kWakeBatch = 8;
+    
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> running{false};
+    int doneFd = -1;
+    size_t next = 0;
+    
+    // Ordering state, only touched by the I/O thread.
+    uint64_t nextSeq = 0;
+    std::map<std::string, std::deque<uint64_t>> order;  // Pending seqs per reply address
+    std::map<uint64_t, VerifyJob> finished;             // Done, waiting for an earlier verdict
+};
+
+std::unique_ptr<VerificationPipeline> pipeline;
+
+// Process one datagram from a client. `origin` is the node that forwarded it
+// over the cluster link, or -1; a forwarded datagram is never forwarded again.
+void handleDatagram(int sockfd, const char* buffer, ssize_t bytesReceived,
+                    const sockaddr_storage& clientAddr, socklen_t clientAddrLen, int origin) {
+    bool forwarded = origin >= 0;
+    if (bytesReceived == sizeof(calcMessage) && !forwarded) {
+        calcMessage* msg = (calcMessage*)buffer;
+        if (bulkCount > 0 && ntohs(msg->major_version) == 1 && ntohs(msg->minor_version) == 1 &&
+            ntohs(msg->protocol) == 17 && ntohl(msg->message) == 0) {
+            int& held = bulkSessions[addressKey(clientAddr, clientAddrLen)];
+            if (held >= kMaxBulkPerAddress) {
+                std::cout << "Too many bulk sessions for one client, hello ignored" << std::endl;
+                return;
+            }
+            held++;
+            ClientInfo client = {sockfd, clientAddr, clientAddrLen, 0, std::chrono::steady_clock::now(), calcProtocol()};
+            std::vector<char> assignment = generateBulkAssignment(client.bulk);
+            calcBulkProtocol header;
+            memcpy(&header, assignment.data(), sizeof(header));
+            client.id = ntohl(header.id);
+            clients[client.id] = client;
+            
+            sendReply(sockfd, assignment.data(), assignment.size(), clientAddr, clientAddrLen);
+            std::cout << "Sent bulk assignment to client" << std::endl;
+        } else if (ntohs(msg->major_version) == 1 && ntohs(msg->minor_version) == 0 &&
+            ntohs(msg->protocol) == 17 && ntohl(msg->message) == 0) {
+            calcProtocol assignment = generateAssignment();
+            ClientInfo client = {sockfd, clientAddr, clientAddrLen, ntohl(assignment.id), std::chrono::steady_clock::now(), assignment};
+            clients[ntohl(assignment.id)] = client;
+            
+            sendReply(sockfd, &assignment, sizeof(assignment), clientAddr, clientAddrLen);
+            std::cout << "Sent assignment to client" << std::endl;
+        }
+    } else if (bytesReceived == sizeof(calcProtocol) || isBulkResult(buffer, bytesReceived)) {
+        bool bulkResult = isBulkResult(buffer, bytesReceived);
+        uint32_t clientId;
+        memcpy(&clientId, buffer + offsetof(calcProtocol, id), sizeof(clientId));
+        clientId = ntohl(clientId);
+        uint32_t owner = ownerOf(clientId);
+        
+        if (owner != cluster.node && !forwarded) {
+            if (sendToNode(owner, kForwardMagic, buffer, bytesReceived, clientAddr, clientAddrLen)) {
+                std::cout << "Forwarded result for client " << clientId << " to node " << owner << std::endl;
+                return;
+            }
+            std::cout << "No link to node " << owner << " for client " << clientId << std::endl;
+        }
+        
+        auto it = clients.find(clientId);
+        
+        if (it != clients.end()) {
+            // A forwarded result is answered, through the node it came in on,
+            // at the address the client used, not where its hello came from.
+            int replyFd = forwarded ? sockfd : it->second.fd;
+            const sockaddr_storage& replyAddr = forwarded ? clientAddr : it->second.addr;
+            socklen_t replyAddrLen = forwarded ? clientAddrLen : it->second.addrLen;
+            
+            if (pipeline) {
+                VerifyJob job;
+                job.client = std::move(it->second);
+                job.origin = origin;
+                job.replyFd = replyFd;
+                job.replyAddr = replyAddr;
+                job.replyAddrLen = replyAddrLen;
+                job.datagram.assign(buffer, buffer + bytesReceived);
+                job.bulkResult = bulkResult;
+                pipeline->submit(job);
+                eraseClient(it);
+                return;
+            }
+            
+            bool correct = checkResult(it->second, buffer, bytesReceived, bulkResult);
+            sendVerdict(clientId, correct, origin, replyFd, replyAddr, replyAddrLen);
+            eraseClient(it);
+        } else {
+            if (!pipeline || !pipeline->holdReject(origin, sockfd, clientAddr, clientAddrLen)) {
+                sendReject(origin, sockfd, clientAddr, clientAddrLen);
+            }
+            std::cout << "Rejected result from unknown or timed-out client" << std::endl;
+        }
+    }
+}
+
+bool sameAddress(const sockaddr_storage& a, const sockaddr_storage& b) {
+    if (a.ss_family != b.ss_family) {
+        return false;
+    }
+    if (a.ss_family == AF_INET) {
+        const sockaddr_in* a4 = (const sockaddr_in*)&a;
+        const sockaddr_in* b4 = (const sockaddr_in*)&b;
+        return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+    if (a.ss_family == AF_INET6) {
+        const sockaddr_in6* a6 = (const sockaddr_in6*)&a;
+        const sockaddr_in6* b6 = (const sockaddr_in6*)&b;
+        return a6->sin6_port == b6->sin6_port &&
+               memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+    }
+    return false;
+}
+
+// Unwrap a clusterForward packet received on the link socket. A forwarded
+// result is handled as if the client had sent it to us; a returned verdict
+// goes out on whichever of our sockets matches the client's address family.
+// Only configured peers are listened to, each only under its own node index,
+// and a verdict must be exactly one calcMessage, so the link cannot be used
+// to relay arbitrary datagrams.
+void handleLinkPacket(int sockfd, int unixFd, const char* packet, ssize_t len,
+                      const sockaddr_storage& from) {
+    if (len < (ssize_t)sizeof(clusterForward)) {
+        return;
+    }
+    clusterForward header;
+    memcpy(&header, packet, sizeof(header));
+    uint32_t magic = ntohl(header.magic);
+    uint32_t origin = ntohl(header.origin);
+    socklen_t clientAddrLen = ntohl(header.addrLen);
+    if ((magic != kForwardMagic && magic != kVerdictMagic) || clientAddrLen > sizeof(sockaddr_storage)) {
+        return;
+    }
+    auto peer = cluster.peers.find(origin);
+    if (peer == cluster.peers.end() || !sameAddress(peer->second.addr, from)) {
+        std::cout << "Dropped link packet from an address that is not node " << origin << std::endl;
+        return;
+    }
+    int family = header.clientAddr.ss_family;
+    if (family != AF_INET && family != AF_INET6 && family != AF_UNIX) {
+        return;
+    }
+#ifdef DEBUG
+    std::cout << "Link packet from node " << origin << std::endl;
+#endif
+    const char* payload = packet + sizeof(header);
+    size_t payloadLen = len - sizeof(header);
+    if (magic == kVerdictMagic && payloadLen != sizeof(calcMessage)) {
+        return;
+    }
+    if (magic == kForwardMagic) {
+        handleDatagram(sockfd, payload, payloadLen, header.clientAddr, clientAddrLen, origin);
+        return;
+    }
+    if (header.clientAddr.ss_family == AF_UNIX) {
+        if (unixFd < 0) {
+            return;
+        }
+        sockfd = unixFd;
+    }
+    sendReply(sockfd, payload, payloadLen, header.clientAddr, clientAddrLen);
+}
+
+void printStats(double seconds) {
+    static uint64_t lastRefilled = 0;
+    std::cout << "Stats: " << clients.size() << " session(s)";
+    if (producer) {
+        uint64_t refilled = producer->refilled.load(std::memory_order_relaxed);
+        std::cout << ", ring " << producer->depth() << "/" << producer->capacity()
+                  << ", refilled " << refilled << " (" << std::fixed << std::setprecision(0)
+                  << (refilled - lastRefilled) / seconds << "/s)" << std::defaultfloat
+                  << ", underruns " << producer->underruns;
+        lastRefilled = refilled;
+    }
+    if (pipeline) {
+        std::cout << ", pipeline in " << pipeline->inDepth() << " out " << pipeline->outDepth()
+                  << std::fixed << std::setprecision(1);
+        const char* names[] = {"wait", "verify", "return"};
+        VerificationPipeline::StageStats* stages[] = {&pipeline->queueWait, &pipeline->verify, &pipeline->returnWait};
+        for (int i = 0; i < 3; i++) {
+            std::cout << ", " << names[i] << " " << stages[i]->avgUs() << "/" << stages[i]->maxUs << "us";
+            stages[i]->reset();
+        }
+        std::cout << std::defaultfloat << ", stalls " << pipeline->stalls << ", overflow " << pipeline->overflow;
+    }
+    if (xdp.isOpen()) {
+        std::cout << ", xdp rx " << xdp.rxPackets << " tx " << xdp.txPackets
+                  << " fallback " << xdp.txFallbacks;
+    }
+    std::cout << std::endl;
+}
+
+volatile sig_atomic_t stopRequested = 0;
+
+void handleStopSignal(int) {
+    stopRequested = 1;
+}
+
+void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " <IP:port> [--unix <path>] [--xdp <ifname>] [--bulk-count <n>] [--ring-depth <n>] [--workers <n> [--queue-depth <n>]] [--stats <seconds>] [--node <n> --link <IP:port> --peer <n>=<IP:port> ...]" << std::endl;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <IP:port>" << std::endl;
+    if (argc < 2) {
+        printUsage(argv[0]);
         return 1;
     }
     
-    std::string arg(argv[1]);
-    size_t colonPos = arg.find(':');
-    if (colonPos == std::string::npos) {
+    std::string ip;
+    int port;
+    if (!splitHostPort(argv[1], ip, port)) {
         std::cerr << "Invalid argument format. Use IP:port" << std::endl;
         return 1;
     }
     
-    std::string ip = arg.substr(0, colonPos);
-    int port = std::stoi(arg.substr(colonPos + 1));
+    std::string linkIp, unixPath, xdpIf;
+    int linkPort = 0;
+    size_t ringDepth = 1024;
+    int numWorkers = 0;
+    size_t queueDepth = 256;
+    int statsInterval = 0;
+    // std::stoul and friends throw on malformed numbers.
+    try {
+        for (int i = 2; i < argc; i++) {
+            std::string opt(argv[i]);
+            if (i + 1 >= argc) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            std::string val(argv[++i]);
+            if (opt == "--node") {
+                cluster.node = std::stoul(val);
+                if (cluster.node >= kMaxNodes) {
+                    std::cerr << "Node index must be below " << kMaxNodes << std::endl;
+                    return 1;
+                }
+            } else if (opt == "--bulk-count") {
+                bulkCount = std::stoul(val);
+                if (bulkCount == 0 || bulkCount > CALC_BULK_MAX) {
+                    std::cerr << "Bulk count must be 1.." << CALC_BULK_MAX << std::endl;
+                    return 1;
+                }
+            } else if (opt == "--ring-depth") {
+                ringDepth = std::stoul(val);
+                if (ringDepth > kMaxRingDepth) {
+                    std::cerr << "Ring depth must be 0.." << kMaxRingDepth << std::endl;
+                    return 1;
+                }
+            } else if (opt == "--workers") {
+                numWorkers = std::stoi(val);
+            } else if (opt == "--queue-depth") {
+                queueDepth = std::stoul(val);
+                if (queueDepth == 0 || queueDepth > kMaxQueueDepth) {
+                    std::cerr << "Queue depth must be 1.." << kMaxQueueDepth << std::endl;
+                    return 1;
+                }
+            } else if (opt == "--stats") {
+                statsInterval = std::stoi(val);
+            } else if (opt == "--xdp") {
+                xdpIf = val;
+            } else if (opt == "--unix") {
+                unixPath = val;
+            } else if (opt == "--link") {
+                if (!splitHostPort(val, linkIp, linkPort)) {
+                    std::cerr << "Invalid link address: " << val << std::endl;
+                    return 1;
+                }
+            } else if (opt == "--peer") {
+                size_t eqPos = val.find('=');
+                std::string peerHost;
+                int peerPort;
+                PeerInfo peer;
+                if (eqPos == std::string::npos || !splitHostPort(val.substr(eqPos + 1), peerHost, peerPort) ||
+                    !resolveAddress(peerHost, peerPort, peer.addr, peer.addrLen)) {
+                    std::cerr << "Invalid peer: " << val << std::endl;
+                    return 1;
+                }
+                uint32_t peerNode = std::stoul(val.substr(0, eqPos));
+                if (peerNode >= kMaxNodes) {
+                    std::cerr << "Node index must be below " << kMaxNodes << std::endl;
+                    return 1;
+                }
+                cluster.peers[peerNode] = peer;
+            } else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+    
+    } catch (const std::exception&) {
+        printUsage(argv[0]);
+        return 1;
+    }
     
     int sockfd = setupSocket(ip.c_str(), port);
+    int unixFd = unixPath.empty() ? -1 : setupUnixSocket(unixPath.c_str());
+    
+    // The UDP socket stays open next to the AF_XDP path: it keeps the port
+    // reserved and receives whatever the XDP program passes to the stack.
+    if (!xdpIf.empty()) {
+        in_addr xdpAddr;
+        if (inet_pton(AF_INET, ip.c_str(), &xdpAddr) != 1) {
+            std::cerr << "The AF_XDP path needs a numeric IPv4 listen address" << std::endl;
+            return 1;
+        }
+        if (!xdp.open(xdpIf, xdpAddr.s_addr, port)) {
+            std::cerr << xdp.error() << std::endl;
+            return 1;
+        }
+        std::cout << "AF_XDP path attached to " << xdpIf << " (generic mode)" << std::endl;
+    }
+    if (linkPort != 0) {
+        cluster.linkFd = setupSocket(linkIp.c_str(), linkPort);
+        std::cout << "Cluster node " << cluster.node << " with " << cluster.peers.size() << " peer(s)" << std::endl;
+    }
     
     initCalcLib();
     
-    while (true) {
+    // SIGINT and SIGTERM stay blocked everywhere except inside pselect() on
+    // this thread, so the worker threads never see them and a signal cannot
+    // slip in between the loop test and the wait.
+    struct sigaction stopAction;
+    memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = handleStopSignal;
+    sigemptyset(&stopAction.sa_mask);
+    sigaction(SIGINT, &stopAction, nullptr);
+    sigaction(SIGTERM, &stopAction, nullptr);
+    sigset_t stopSignals, waitMask;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stopSignals, &waitMask);
+    
+    // 0 turns the producer off and assignments are generated inline again.
+    if (ringDepth > 0) {
+        producer.reset(new AssignmentProducer(ringDepth));
+        if (!producer->start()) {
+            perror("eventfd");
+            exit(1);
+        }
+    }
+    
+    if (numWorkers > 0) {
+        pipeline.reset(new VerificationPipeline(numWorkers, queueDepth));
+        if (!pipeline->start()) {
+            perror("eventfd");
+            exit(1);
+        }
+        std::cout << "Verifying on " << numWorkers << " worker thread(s)" << std::endl;
+    }
+    
+    auto lastStats = std::chrono::steady_clock::now();
+    
+    while (!stopRequested) {
         removeInactiveClients();
         
-        char buffer[sizeof(calcProtocol)];
-        sockaddr_storage clientAddr;
-        socklen_t clientAddrLen = sizeof(clientAddr);
+        struct timespec statsTimeout;
+        struct timespec* timeout = nullptr;
+        if (statsInterval > 0) {
+            auto now = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double>(now - lastStats).count();
+            if (elapsed >= statsInterval) {
+                printStats(elapsed);
+                lastStats = now;
+                elapsed = 0;
+            }
+            long remainingUs = (statsInterval - elapsed) * 1e6;
+            statsTimeout.tv_sec = remainingUs / 1000000;
+            statsTimeout.tv_nsec = remainingUs % 1000000 * 1000;
+            timeout = &statsTimeout;
+        }
         
-        ssize_t bytesReceived = recvfrom(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr*)&clientAddr, &clientAddrLen);
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        int maxFd = -1;
+        // Backpressure: with every worker queue full, only wait for verdicts.
+        bool stalled = pipeline && pipeline->full();
+        if (stalled) {
+            pipeline->stalls++;
+        }
+        for (int fd : {sockfd, unixFd, xdp.isOpen() ? xdp.fd() : -1, cluster.linkFd}) {
+            if (fd >= 0 && !stalled) {
+                FD_SET(fd, &readfds);
+                maxFd = std::max(maxFd, fd);
+            }
+        }
+        if (pipeline) {
+            FD_SET(pipeline->fd(), &readfds);
+            maxFd = std::max(maxFd, pipeline->fd());
+        }
         
-        if (bytesReceived == sizeof(calcMessage)) {
-            calcMessage* msg = (calcMessage*)buffer;
-            if (ntohs(msg->major_version) == 1 && ntohs(msg->minor_version) == 0 &&
-                ntohs(msg->protocol) == 17 && ntohl(msg->message) == 0) {
-                calcProtocol assignment = generateAssignment();
-                ClientInfo client = {clientAddr, clientAddrLen, ntohl(assignment.id), std::chrono::steady_clock::now(), assignment};
-                clients[ntohl(assignment.id)] = client;
-                
-                sendto(sockfd, &assignment, sizeof(assignment), 0, (struct sockaddr*)&clientAddr, clientAddrLen);
-                std::cout << "Sent assignment to client" << std::endl;
-            }
-        } else if (bytesReceived == sizeof(calcProtocol)) {
-            calcProtocol* result = (calcProtocol*)buffer;
-            int clientId = ntohl(result->id);
-            auto it = clients.find(clientId);
+        if (pselect(maxFd + 1, &readfds, nullptr, nullptr, timeout, &waitMask) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("pselect");
+            break;
+        }
+        
+        for (int fd : {sockfd, unixFd}) {
+            if (fd < 0 || !FD_ISSET(fd, &readfds)) {
+                continue;
+            }
+            char buffer[CALC_BULK_MAX_DATAGRAM];
+            sockaddr_storage clientAddr;
+            socklen_t clientAddrLen = sizeof(clientAddr);
             
-            if (it != clients.end()) {
-                calcMessage response;
-                response.major_version = htons(1);
-                response.minor_version = htons(0);
-                response.protocol = htons(17);
-                response.type = htons(2);
-                
-                if (verifyResult(it->second.assignment, *result)) {
-                    response.message = htonl(1);  // OK
-                    std::cout << "Client " << clientId << " provided correct result" << std::endl;
-                } else {
-                    response.message = htonl(2);  // NOT OK
-                    std::cout << "Client " << clientId << " provided incorrect result" << std::endl;
-                }
-                
-                sendto(sockfd, &response, sizeof(response), 0, (struct sockaddr*)&it->second.addr, it->second.addrLen);
-                clients.erase(it);
-            } else {
-                calcMessage errorResponse;
-                errorResponse.major_version = htons(1);
-                errorResponse.minor_version = htons(0);
-                errorResponse.protocol = htons(17);
-                errorResponse.type = htons(2);
-                errorResponse.message = htonl(2);  // NOT OK
-                sendto(sockfd, &errorResponse, sizeof(errorResponse), 0, (struct sockaddr*)&clientAddr, clientAddrLen);
-                std::cout << "Rejected result from unknown or timed-out client" << std::endl;
+            ssize_t bytesReceived = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr*)&clientAddr, &clientAddrLen);
+            handleDatagram(fd, buffer, bytesReceived, clientAddr, clientAddrLen, -1);
+        }
+        
+        if (xdp.isOpen() && FD_ISSET(xdp.fd(), &readfds)) {
+            xdp.poll([&](const char* payload, size_t len, const sockaddr_storage& from, socklen_t fromLen) {
+                handleDatagram(sockfd, payload, len, from, fromLen, -1);
+            });
+        }
+        
+        if (cluster.linkFd >= 0 && FD_ISSET(cluster.linkFd, &readfds)) {
+            char packet[sizeof(clusterForward) + CALC_BULK_MAX_DATAGRAM];
+            sockaddr_storage from;
+            socklen_t fromLen = sizeof(from);
+            ssize_t len = recvfrom(cluster.linkFd, packet, sizeof(packet), 0, (struct sockaddr*)&from, &fromLen);
+            handleLinkPacket(sockfd, unixFd, packet, len, from);
+        }
+        
+        if (pipeline) {
+            pipeline->flush();
+            if (FD_ISSET(pipeline->fd(), &readfds)) {
+                pipeline->drain();
             }
         }
     }
     
+    std::cout << "Shutting down" << std::endl;
+    if (pipeline) {
+        pipeline->stop();
+    }
+    if (producer) {
+        producer->stop();
+    }
     close(sockfd);
+    if (unixFd >= 0) {
+        close(unixFd);
+        unlink(unixPath.c_str());
+    }
     return 0;
 }
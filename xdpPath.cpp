@@ -0,0 +1,448 @@
+#include <cstring>
+#include <cerrno>
+#include <cstddef>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+
+#include "xdpPath.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+const uint32_t kFrameSize = 4096;
+const uint32_t kNumFrames = 4096;
+const uint32_t kRingSize = 2048;
+// Frames larger than this are left to the kernel stack.
+const uint32_t kMaxRedirect = 2048;
+const size_t kHeaders = sizeof(ethhdr) + sizeof(iphdr) + sizeof(udphdr);
+
+static long sysBpf(int cmd, union bpf_attr* attr) {
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static bpf_insn insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) {
+    bpf_insn i;
+    memset(&i, 0, sizeof(i));
+    i.code = code;
+    i.dst_reg = dst;
+    i.src_reg = src;
+    i.off = off;
+    i.imm = imm;
+    return i;
+}
+
+static uint16_t checksumFold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+static uint32_t checksumAdd(uint32_t sum, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        sum += (p[i] << 8) | p[i + 1];
+    }
+    if (len & 1) {
+        sum += p[len - 1] << 8;
+    }
+    return sum;
+}
+
+template <typename T>
+static T* ringEntry(void* desc, uint32_t index, uint32_t size) {
+    return (T*)desc + (index & (size - 1));
+}
+
+XdpPath::~XdpPath() {
+    close();
+}
+
+bool XdpPath::fail(const std::string& what) {
+    lastError = what + ": " + strerror(errno);
+    close();
+    return false;
+}
+
+bool XdpPath::open(const std::string& ifname, in_addr_t addr, uint16_t port) {
+    close();
+
+    unsigned ifindex = if_nametoindex(ifname.c_str());
+    if (ifindex == 0) {
+        return fail("Unknown interface " + ifname);
+    }
+
+    // Frames transmitted on loopback come straight back in, and the kernel
+    // drops them as martians (127/8 source, or one of our own addresses,
+    // unless route_localnet and accept_local are set), so every reply written
+    // into a frame would vanish. Refuse instead of silently going dark.
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    if (probe < 0 || ioctl(probe, SIOCGIFFLAGS, &ifr) < 0) {
+        if (probe >= 0) {
+            ::close(probe);
+        }
+        return fail("Reading flags of " + ifname);
+    }
+    ::close(probe);
+    if (ifr.ifr_flags & IFF_LOOPBACK) {
+        lastError = ifname + " is a loopback interface; replies sent through AF_XDP there are "
+                    "dropped by the kernel (see net.ipv4.conf.*.route_localnet and accept_local). "
+                    "Use a real or veth interface, or leave out --xdp";
+        close();
+        return false;
+    }
+
+    xskFd = socket(AF_XDP, SOCK_RAW, 0);
+    if (xskFd < 0) {
+        return fail("AF_XDP socket");
+    }
+    if (!setupUmem()) {
+        return false;
+    }
+
+    struct sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = ifindex;
+    sxdp.sxdp_queue_id = 0;
+    sxdp.sxdp_flags = XDP_COPY;
+    if (bind(xskFd, (struct sockaddr*)&sxdp, sizeof(sxdp)) < 0) {
+        return fail("Binding AF_XDP socket to " + ifname);
+    }
+
+    if (!loadProgram(addr, port)) {
+        return false;
+    }
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    uint32_t queue = 0;
+    attr.map_fd = mapFd;
+    attr.key = (uint64_t)(uintptr_t)&queue;
+    attr.value = (uint64_t)(uintptr_t)&xskFd;
+    if (sysBpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        return fail("Adding socket to XSKMAP");
+    }
+
+    // A bpf_link detaches the program by itself when the server exits.
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = progFd;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    linkFd = sysBpf(BPF_LINK_CREATE, &attr);
+    if (linkFd < 0) {
+        return fail("Attaching XDP program to " + ifname);
+    }
+    return true;
+}
+
+void XdpPath::close() {
+    for (int* fd : {&linkFd, &progFd, &mapFd, &xskFd}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+    for (Ring* ring : {&rx, &tx, &fill, &comp}) {
+        if (ring->map) {
+            munmap(ring->map, ring->mapLen);
+        }
+        *ring = Ring();
+    }
+    if (umem) {
+        munmap(umem, umemLen);
+        umem = nullptr;
+    }
+}
+
+bool XdpPath::setupUmem() {
+    umemLen = (size_t)kFrameSize * kNumFrames;
+    void* area = mmap(nullptr, umemLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED) {
+        return fail("Allocating UMEM");
+    }
+    umem = (char*)area;
+
+    struct xdp_umem_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (uint64_t)(uintptr_t)umem;
+    reg.len = umemLen;
+    reg.chunk_size = kFrameSize;
+    reg.headroom = 0;
+    if (setsockopt(xskFd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) {
+        return fail("Registering UMEM");
+    }
+
+    // The fill ring holds every frame, so returning a frame to it never blocks.
+    uint32_t fillSize = kNumFrames;
+    uint32_t ringSize = kRingSize;
+    if (setsockopt(xskFd, SOL_XDP, XDP_UMEM_FILL_RING, &fillSize, sizeof(fillSize)) < 0 ||
+        setsockopt(xskFd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ringSize, sizeof(ringSize)) < 0 ||
+        setsockopt(xskFd, SOL_XDP, XDP_RX_RING, &ringSize, sizeof(ringSize)) < 0 ||
+        setsockopt(xskFd, SOL_XDP, XDP_TX_RING, &ringSize, sizeof(ringSize)) < 0) {
+        return fail("Sizing AF_XDP rings");
+    }
+
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (getsockopt(xskFd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+        return fail("Reading AF_XDP ring offsets");
+    }
+
+    fill.size = fillSize;
+    comp.size = rx.size = tx.size = ringSize;
+    if (!mapRing(rx, XDP_PGOFF_RX_RING, off.rx, sizeof(xdp_desc)) ||
+        !mapRing(tx, XDP_PGOFF_TX_RING, off.tx, sizeof(xdp_desc)) ||
+        !mapRing(fill, XDP_UMEM_PGOFF_FILL_RING, off.fr, sizeof(uint64_t)) ||
+        !mapRing(comp, XDP_UMEM_PGOFF_COMPLETION_RING, off.cr, sizeof(uint64_t))) {
+        return false;
+    }
+
+    // Hand the kernel every frame to receive into.
+    for (uint32_t i = 0; i < kNumFrames; i++) {
+        refill((uint64_t)i * kFrameSize);
+    }
+    return true;
+}
+
+bool XdpPath::mapRing(Ring& ring, uint64_t pgoff, const struct xdp_ring_offset& off, size_t descSize) {
+    ring.mapLen = off.desc + ring.size * descSize;
+    void* map = mmap(nullptr, ring.mapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xskFd, pgoff);
+    if (map == MAP_FAILED) {
+        ring.map = nullptr;
+        return fail("Mapping AF_XDP ring");
+    }
+    ring.map = map;
+    ring.producer = (uint32_t*)((char*)map + off.producer);
+    ring.consumer = (uint32_t*)((char*)map + off.consumer);
+    ring.desc = (char*)map + off.desc;
+    return true;
+}
+
+// Build the XDP program by hand:
+//   if (eth/ipv4/udp, no IP options, not a fragment, dport == port,
+//       daddr == addr or addr is INADDR_ANY, frame fits in a UMEM frame)
+//       return bpf_redirect_map(&xsks, rx_queue_index, XDP_PASS);
+//   return XDP_PASS;
+bool XdpPath::loadProgram(in_addr_t addr, uint16_t port) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = 64;
+    mapFd = sysBpf(BPF_MAP_CREATE, &attr);
+    if (mapFd < 0) {
+        return fail("Creating XSKMAP");
+    }
+
+    const int16_t pass = -1;  // Patched to jump to the XDP_PASS exit below
+    std::vector<bpf_insn> prog = {
+        insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+        insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(xdp_md, data), 0),
+        insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_1, offsetof(xdp_md, data_end), 0),
+        insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+        insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, kHeaders),
+        insn(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, pass, 0),
+        insn(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+        insn(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, kMaxRedirect),
+        insn(BPF_JMP | BPF_JLT | BPF_X, BPF_REG_4, BPF_REG_3, pass, 0),
+        insn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, offsetof(ethhdr, h_proto), 0),
+        insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, pass, htons(ETH_P_IP)),
+        insn(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, sizeof(ethhdr), 0),
+        insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, pass, 0x45),
+        insn(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, sizeof(ethhdr) + offsetof(iphdr, protocol), 0),
+        insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, pass, IPPROTO_UDP),
+        insn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, sizeof(ethhdr) + offsetof(iphdr, frag_off), 0),
+        insn(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, htons(0x3fff)),
+        insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, pass, 0),
+        insn(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, sizeof(ethhdr) + sizeof(iphdr) + offsetof(udphdr, dest), 0),
+        insn(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, pass, htons(port)),
+    };
+    if (addr != htonl(INADDR_ANY)) {
+        prog.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, sizeof(ethhdr) + offsetof(iphdr, daddr), 0));
+        prog.push_back(insn(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_5, 0, pass, (int32_t)addr));
+    }
+    prog.push_back(insn(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, mapFd));
+    prog.push_back(insn(0, 0, 0, 0, 0));
+    prog.push_back(insn(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, offsetof(xdp_md, rx_queue_index), 0));
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS));
+    prog.push_back(insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map));
+    prog.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+    size_t passAt = prog.size();
+    prog.push_back(insn(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS));
+    prog.push_back(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+    for (size_t i = 0; i < passAt; i++) {
+        uint8_t cls = BPF_CLASS(prog[i].code);
+        if ((cls == BPF_JMP || cls == BPF_JMP32) && BPF_OP(prog[i].code) != BPF_CALL &&
+            BPF_OP(prog[i].code) != BPF_EXIT && prog[i].off == pass) {
+            prog[i].off = passAt - (i + 1);
+        }
+    }
+
+    static char log[65536];
+    const char license[] = "GPL";
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insn_cnt = prog.size();
+    attr.insns = (uint64_t)(uintptr_t)prog.data();
+    attr.license = (uint64_t)(uintptr_t)license;
+    attr.log_buf = (uint64_t)(uintptr_t)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    progFd = sysBpf(BPF_PROG_LOAD, &attr);
+    if (progFd < 0) {
+        return fail(std::string("Loading XDP program (") + log + ")");
+    }
+    return true;
+}
+
+void XdpPath::refill(uint64_t addr) {
+    uint32_t prod = *fill.producer;
+    *ringEntry<uint64_t>(fill.desc, prod, fill.size) = addr;
+    __atomic_store_n(fill.producer, prod + 1, __ATOMIC_RELEASE);
+}
+
+void XdpPath::reclaimCompleted() {
+    uint32_t cons = *comp.consumer;
+    uint32_t prod = __atomic_load_n(comp.producer, __ATOMIC_ACQUIRE);
+    for (; cons != prod; cons++) {
+        refill(*ringEntry<uint64_t>(comp.desc, cons, comp.size));
+    }
+    __atomic_store_n(comp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+int XdpPath::poll(const Handler& handler) {
+    reclaimCompleted();
+
+    uint32_t cons = *rx.consumer;
+    uint32_t prod = __atomic_load_n(rx.producer, __ATOMIC_ACQUIRE);
+    int handled = 0;
+    bool queued = false;
+
+    for (; cons != prod; cons++, handled++) {
+        xdp_desc desc = *ringEntry<xdp_desc>(rx.desc, cons, rx.size);
+        char* frame = umem + desc.addr;
+        rxPackets++;
+
+        // The program already checked the headers; only the UDP length is new.
+        udphdr* udp = (udphdr*)(frame + sizeof(ethhdr) + sizeof(iphdr));
+        size_t payloadLen = ntohs(udp->len) - sizeof(udphdr);
+        if (desc.len < kHeaders || payloadLen > desc.len - kHeaders) {
+            refill(desc.addr);
+            continue;
+        }
+
+        iphdr* ip = (iphdr*)(frame + sizeof(ethhdr));
+        sockaddr_storage from;
+        memset(&from, 0, sizeof(from));
+        sockaddr_in* sin = (sockaddr_in*)&from;
+        sin->sin_family = AF_INET;
+        sin->sin_addr.s_addr = ip->saddr;
+        sin->sin_port = udp->source;
+
+        current.data = frame;
+        current.addr = desc.addr;
+        current.replyLen = 0;
+        handler(frame + kHeaders, payloadLen, from, sizeof(sockaddr_in));
+        size_t replyLen = current.replyLen;
+        current = Frame();
+
+        if (replyLen == 0) {
+            refill(desc.addr);
+            continue;
+        }
+
+        // The TX ring is as large as the RX ring, but a slow completion ring
+        // could still leave it full; drop the reply rather than spin.
+        uint32_t txProd = *tx.producer;
+        if (txProd - __atomic_load_n(tx.consumer, __ATOMIC_ACQUIRE) >= tx.size) {
+            refill(desc.addr);
+            continue;
+        }
+        xdp_desc* out = ringEntry<xdp_desc>(tx.desc, txProd, tx.size);
+        out->addr = desc.addr;
+        out->len = kHeaders + replyLen;
+        out->options = 0;
+        __atomic_store_n(tx.producer, txProd + 1, __ATOMIC_RELEASE);
+        txPackets++;
+        queued = true;
+    }
+    __atomic_store_n(rx.consumer, cons, __ATOMIC_RELEASE);
+
+    // Copy mode always needs a kick to transmit.
+    if (queued) {
+        sendto(xskFd, nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+        reclaimCompleted();
+    }
+    return handled;
+}
+
+bool XdpPath::reply(const void* data, size_t len, const sockaddr_storage& to) {
+    // Replies to datagrams that came in on the kernel socket are not ours.
+    if (!current.data) {
+        return false;
+    }
+    if (current.replyLen != 0 || len > kMaxRedirect - kHeaders) {
+        txFallbacks++;
+        return false;
+    }
+
+    ethhdr* eth = (ethhdr*)current.data;
+    iphdr* ip = (iphdr*)(current.data + sizeof(ethhdr));
+    udphdr* udp = (udphdr*)(current.data + sizeof(ethhdr) + sizeof(iphdr));
+    const sockaddr_in* sin = (const sockaddr_in*)&to;
+    if (to.ss_family != AF_INET || sin->sin_addr.s_addr != ip->saddr || sin->sin_port != udp->source) {
+        txFallbacks++;
+        return false;
+    }
+
+    // The request payload has been consumed by now, so overwrite it in place.
+    memmove(current.data + kHeaders, data, len);
+
+    unsigned char mac[ETH_ALEN];
+    memcpy(mac, eth->h_dest, ETH_ALEN);
+    memcpy(eth->h_dest, eth->h_source, ETH_ALEN);
+    memcpy(eth->h_source, mac, ETH_ALEN);
+
+    std::swap(ip->saddr, ip->daddr);
+    ip->tot_len = htons(sizeof(iphdr) + sizeof(udphdr) + len);
+    ip->id = 0;
+    ip->ttl = 64;
+    ip->check = 0;
+    ip->check = htons(checksumFold(checksumAdd(0, ip, sizeof(iphdr))));
+
+    std::swap(udp->source, udp->dest);
+    udp->len = htons(sizeof(udphdr) + len);
+    udp->check = 0;
+    uint32_t sum = checksumAdd(0, &ip->saddr, 2 * sizeof(ip->saddr));
+    sum += IPPROTO_UDP + sizeof(udphdr) + len;
+    sum = checksumAdd(sum, udp, sizeof(udphdr) + len);
+    udp->check = htons(checksumFold(sum));
+    if (udp->check == 0) {
+        udp->check = 0xffff;
+    }
+
+    current.replyLen = len;
+    return true;
+}
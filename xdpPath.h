@@ -0,0 +1,101 @@
+#ifndef __XDP_PATH
+#define __XDP_PATH
+
+/*
+
+Optional AF_XDP fast path for servermain.
+
+open() loads a small XDP program onto an interface in generic (SKB) mode, so
+it works on veth and other interfaces without driver support. Loopback is
+refused: replies transmitted there loop straight back in and are dropped by
+the kernel. The program redirects only unfragmented UDP/IPv4 datagrams
+addressed to our port, and only those small enough for one UMEM frame, into
+an AF_XDP socket bound to queue 0.
+Everything else, including large bulk datagrams, stays on the kernel stack
+and reaches the ordinary UDP socket.
+
+poll() hands each redirected payload to the caller straight from its UMEM
+frame. If the caller answers through reply() while that frame is being
+handled, the reply is written back into the same frame (headers swapped,
+checksums recomputed) and queued for transmit, without a copy through the
+kernel socket.
+
+This is built from the kernel UAPI headers and raw bpf() calls, so it needs
+no libbpf, but it does need root (CAP_NET_ADMIN and CAP_BPF).
+
+*/
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/if_xdp.h>
+
+class XdpPath {
+public:
+    typedef std::function<void(const char* payload, size_t len,
+                               const sockaddr_storage& from, socklen_t fromLen)> Handler;
+
+    XdpPath() = default;
+    ~XdpPath();
+
+    XdpPath(const XdpPath&) = delete;
+    XdpPath& operator=(const XdpPath&) = delete;
+
+    // addr is in network byte order; INADDR_ANY matches any destination.
+    bool open(const std::string& ifname, in_addr_t addr, uint16_t port);
+    void close();
+
+    bool isOpen() const { return xskFd >= 0; }
+    int fd() const { return xskFd; }
+    const std::string& error() const { return lastError; }
+
+    // Handle every frame in the RX ring. Returns the number of frames handled.
+    int poll(const Handler& handler);
+
+    // Answer the frame currently being handled. Returns false (and the caller
+    // should fall back to the kernel socket) if no frame is being handled, the
+    // reply is for another address, or it does not fit in the frame.
+    bool reply(const void* data, size_t len, const sockaddr_storage& to);
+
+    uint64_t rxPackets = 0;
+    uint64_t txPackets = 0;
+    uint64_t txFallbacks = 0;  // Replies to an XDP frame that went out through the kernel socket
+
+private:
+    struct Ring {
+        uint32_t* producer = nullptr;
+        uint32_t* consumer = nullptr;
+        void* desc = nullptr;
+        uint32_t size = 0;
+        void* map = nullptr;
+        size_t mapLen = 0;
+    };
+
+    struct Frame {
+        char* data = nullptr;  // Ethernet header of the frame being handled
+        uint64_t addr = 0;
+        size_t replyLen = 0;   // Set by reply()
+    };
+
+    bool fail(const std::string& what);
+    bool setupUmem();
+    bool mapRing(Ring& ring, uint64_t pgoff, const struct xdp_ring_offset& off, size_t descSize);
+    bool loadProgram(in_addr_t addr, uint16_t port);
+    void refill(uint64_t addr);
+    void reclaimCompleted();
+
+    int xskFd = -1;
+    int mapFd = -1;
+    int progFd = -1;
+    int linkFd = -1;
+    char* umem = nullptr;
+    size_t umemLen = 0;
+    Ring rx, tx, fill, comp;
+    Frame current;
+    std::string lastError;
+};
+
+#endif